@@ -2,6 +2,8 @@
 #include "game.h"
 #include "playerdb.h"
 #include "admin.h"
+#include "admission.h"
+#include "endpoint_table.h"
 #include <print>
 #include <utility>
 #include <map>
@@ -71,10 +73,11 @@ class AdminClient
 	GameDB& m_GameDB;
 	PlayerDB& m_PlayerDB;
 	std::string_view m_Auth;
+	const std::map<std::string, AdminServer::StatsProvider>& m_StatsProviders;
 
 public:
-	AdminClient(tcp::socket socket, GameDB& gameDB, PlayerDB &playerDB, std::string_view auth)
-		: m_Socket(std::move(socket)), m_GameDB(gameDB), m_PlayerDB(playerDB), m_Auth(auth)
+	AdminClient(tcp::socket socket, GameDB& gameDB, PlayerDB &playerDB, std::string_view auth, const std::map<std::string, AdminServer::StatsProvider>& statsProviders)
+		: m_Socket(std::move(socket)), m_GameDB(gameDB), m_PlayerDB(playerDB), m_Auth(auth), m_StatsProviders(statsProviders)
 	{
 
 	}
@@ -130,6 +133,19 @@ public:
 			co_await SendResponse(request, http::status::ok, games);
 			co_return true;
 		}
+		else if (path == "/api/stats") {
+			if (method != http::verb::get) {
+				co_await SendResponse(request, http::status::bad_request, { {"error", "invalid http method"} });
+				co_return false;
+			}
+
+			auto stats = nlohmann::json::object();
+			for (const auto& [name, provider] : m_StatsProviders)
+				stats[name] = provider();
+
+			co_await SendResponse(request, http::status::ok, stats);
+			co_return true;
+		}
 
 		// all other api calls require a game parameter
 		if (!params.contains("game")) {
@@ -201,11 +217,13 @@ public:
 				};
 
 				co_await game->AddOrUpdateServer(server);
+				game->Flush(); // not batched with the heartbeats
 				co_await SendResponse(request, http::status::ok, nlohmann::json{ {"status", "success"}, {"message", "added server"} });
 				co_return true;
 			}
 			else if (request.method() == http::verb::delete_) {
 				co_await game->RemoveServers({ { (*params.find("ip"))->value, static_cast<std::uint16_t>(*port) } });
+				game->Flush();
 				co_await SendResponse(request, http::status::ok, nlohmann::json{ {"status", "success"}, {"message", "removed server"} });
 				co_return true;
 			}
@@ -214,6 +232,85 @@ public:
 			co_return false;
 		}
 
+		else if (path == "/api/players") {
+			if (request.method() != http::verb::get) {
+				co_await SendResponse(request, http::status::bad_request, { {"error", "invalid http method"} });
+				co_return false;
+			}
+
+			const auto& roster = game->roster();
+			auto players = nlohmann::json::array();
+			auto found = params.contains("name") ? roster.FindPlayers((*params.find("name"))->value) : roster.GetAllPlayers();
+			for (const auto& player : found) {
+				const auto endpoint = endpoint_from_key(player.server);
+				players.push_back(nlohmann::json{
+					{"name", player.name},
+					{"score", player.score},
+					{"ping", player.ping},
+					{"team", player.team},
+					{"ip", endpoint.address().to_string()},
+					{"port", endpoint.port()}
+				});
+			}
+
+			co_await SendResponse(request, http::status::ok, players);
+			co_return true;
+		}
+		else if (path == "/api/maps") {
+			if (request.method() != http::verb::get) {
+				co_await SendResponse(request, http::status::bad_request, { {"error", "invalid http method"} });
+				co_return false;
+			}
+
+			auto maps = nlohmann::json::object();
+			for (const auto& [map, players] : game->roster().GetPlayersPerMap())
+				maps[std::string{ map }] = players;
+
+			co_await SendResponse(request, http::status::ok, maps);
+			co_return true;
+		}
+		else if (path == "/api/indexes") {
+			if (request.method() != http::verb::get) {
+				co_await SendResponse(request, http::status::bad_request, { {"error", "invalid http method"} });
+				co_return false;
+			}
+
+			auto columns = nlohmann::json::object();
+			for (const auto& column : game->GetColumnStats()) {
+				columns[std::string{ column.name }] = {
+					{ "queries", column.queries },
+					{ "indexed", column.indexed },
+					{ "values", column.values },
+					{ "hits", column.hits }
+				};
+			}
+
+			co_await SendResponse(request, http::status::ok, columns);
+			co_return true;
+		}
+		else if (path == "/api/refresh") {
+			if (request.method() != http::verb::post) {
+				co_await SendResponse(request, http::status::bad_request, { {"error", "invalid http method"} });
+				co_return false;
+			}
+
+			auto error = std::string{};
+			try {
+				co_await game->Refresh();
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+
+			if (!error.empty()) {
+				co_await SendResponse(request, http::status::internal_server_error, { {"error", error} });
+				co_return false;
+			}
+
+			co_await SendResponse(request, http::status::ok, nlohmann::json{ {"status", "success"}, {"message", "refreshed game"} });
+			co_return true;
+		}
+
 		co_await SendResponse(request, http::status::not_found);
 		co_return false;
 	}
@@ -292,8 +389,8 @@ public:
 	}
 };
 
-AdminServer::AdminServer(boost::asio::io_context& context, GameDB& gameDB, PlayerDB& playerDB, const std::string& username, const std::string& password, boost::asio::ip::port_type port)
-	: m_Acceptor(context, tcp::v6()), m_GameDB(gameDB), m_PlayerDB(playerDB)
+AdminServer::AdminServer(boost::asio::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB, const std::string& username, const std::string& password, boost::asio::ip::port_type port)
+	: m_Acceptor(context, tcp::v6()), m_Admission(admission), m_GameDB(gameDB), m_PlayerDB(playerDB)
 {
 	m_Acceptor.set_option(tcp::acceptor::reuse_address(true));
 	if (username.empty() || password.empty()) {
@@ -321,6 +418,10 @@ boost::asio::awaitable<void> AdminServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		net::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), net::detached);
 	}
 }
@@ -328,10 +429,15 @@ boost::asio::awaitable<void> AdminServer::AcceptClients()
 boost::asio::awaitable<void> AdminServer::HandleIncoming(boost::asio::ip::tcp::socket socket)
 {
 	try {
-		auto client = AdminClient{ std::move(socket), m_GameDB, m_PlayerDB, m_Auth };
+		auto client = AdminClient{ std::move(socket), m_GameDB, m_PlayerDB, m_Auth, m_StatsProviders };
 		co_await client.Run();
 	}
 	catch (const std::exception& e) {
 		std::println("[admin] connection failed {}", e.what());
 	}
+}
+
+void AdminServer::AddStatsProvider(const std::string& name, StatsProvider provider)
+{
+	m_StatsProviders.insert_or_assign(name, std::move(provider));
 }
\ No newline at end of file
@@ -3,25 +3,39 @@
 #define _GAMESPY_ADMIN_H_
 
 #include "asio.h"
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <string>
 
 namespace gamespy
 {
+	class Admission;
 	class GameDB;
 	class PlayerDB;
 	class AdminServer
 	{
 		boost::asio::ip::tcp::acceptor m_Acceptor;
+		Admission& m_Admission;
 		GameDB& m_GameDB;
 		PlayerDB& m_PlayerDB;
 		std::string m_Auth;
 
 	public:
-		AdminServer(boost::asio::io_context& context, GameDB& gameDB, PlayerDB& playerDB, const std::string& username, const std::string& password, boost::asio::ip::port_type port);
+		// named counters reported by /api/stats
+		using StatsProvider = std::function<std::map<std::string, std::uint64_t>()>;
+
+	private:
+		std::map<std::string, StatsProvider> m_StatsProviders;
+
+	public:
+		AdminServer(boost::asio::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB, const std::string& username, const std::string& password, boost::asio::ip::port_type port);
 		~AdminServer();
 
 		boost::asio::awaitable<void> AcceptClients();
 
+		void AddStatsProvider(const std::string& name, StatsProvider provider);
+
 	private:
 		boost::asio::awaitable<void> HandleIncoming(boost::asio::ip::tcp::socket socket);
 	};
@@ -0,0 +1,83 @@
+#include "admission.h"
+#include <algorithm>
+#include <bit>
+using namespace gamespy;
+
+namespace {
+	std::uint64_t source_key(const boost::asio::ip::address& address)
+	{
+		auto key = std::uint64_t{};
+		if (address.is_v4())
+			key = address.to_v4().to_uint();
+		else {
+			// ipv6 sources are tracked by their /64 prefix (a single host usually controls the whole prefix)
+			const auto bytes = address.to_v6().to_bytes();
+			for (std::size_t i = 0; i < 8; i++)
+				key = (key << 8) | bytes[i];
+
+			key ^= 0x8000000000000000ull; // keep ipv4 and ipv6 keys apart
+		}
+
+		// 0 marks empty buckets (0.0.0.0 and ::/64 are no valid sources anyways)
+		return key == 0 ? 1 : key;
+	}
+}
+
+Admission::Admission(Config config)
+	: m_Config{ config },
+	m_Buckets(std::bit_ceil(std::max<std::size_t>(config.capacity, PROBE_WINDOW))),
+	m_Mask{ m_Buckets.size() - 1 },
+	m_Epoch{ SteadyClock::now() }
+{
+
+}
+
+bool Admission::Admit(const boost::asio::ip::address& address, SteadyClock::time_point now)
+{
+	if (!enabled()) {
+		m_Stats.admitted.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	const auto key = ::source_key(address);
+	const auto time = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_Epoch).count());
+	const auto start = static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & m_Mask;
+
+	// find the source within the probe window, otherwise replace the empty or least recently seen bucket
+	auto* bucket = static_cast<Bucket*>(nullptr);
+	auto* victim = &m_Buckets[start];
+	for (std::size_t i = 0; i < PROBE_WINDOW; i++) {
+		auto& candidate = m_Buckets[(start + i) & m_Mask];
+		if (candidate.key == key) {
+			bucket = &candidate;
+			break;
+		}
+
+		// unsigned arithmetic: correct across the wrap-around of the millisecond counter
+		if (victim->key != 0 && (candidate.key == 0 || time - candidate.last_seen > time - victim->last_seen))
+			victim = &candidate;
+	}
+
+	if (bucket) {
+		const auto elapsed = std::chrono::duration<double>(std::chrono::milliseconds{ time - bucket->last_seen }).count();
+		bucket->tokens = static_cast<float>(std::min(m_Config.burst, bucket->tokens + elapsed * m_Config.rate));
+	}
+	else {
+		if (victim->key != 0)
+			m_Stats.evicted.fetch_add(1, std::memory_order_relaxed);
+
+		bucket = victim;
+		bucket->key = key;
+		bucket->tokens = static_cast<float>(m_Config.burst);
+	}
+
+	bucket->last_seen = time;
+	if (bucket->tokens < 1) {
+		m_Stats.dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	bucket->tokens -= 1;
+	m_Stats.admitted.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef _GAMESPY_ADMISSION_H_
+#define _GAMESPY_ADMISSION_H_
+
+#include "asio.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gamespy {
+	// per source address token bucket (admission control for the udp and tcp servers):
+	// every datagram / connection costs one token, the tokens are refilled with the configured rate up to the burst size.
+	// the buckets are kept in a fixed-size open-addressing table, a new source replaces the least recently seen entry
+	// within its probe window (LRU decay), so the memory usage does not depend on the number of sources.
+	// an evicted source starts again with a full bucket, which is the state it would have reached by being idle anyway.
+	//
+	// not thread-safe (except for the stats), each thread (e.g. master shard) has to use its own instance
+	class Admission
+	{
+	public:
+		using SteadyClock = std::chrono::steady_clock;
+
+		struct Config
+		{
+			double rate = 0; // tokens per second (0 = unlimited)
+			double burst = 0; // bucket size
+			std::size_t capacity = 1 << 16; // number of tracked sources (rounded up to a power of two)
+		};
+
+		struct Stats
+		{
+			std::atomic<std::uint64_t> admitted;
+			std::atomic<std::uint64_t> dropped;
+			std::atomic<std::uint64_t> evicted;
+		};
+
+	private:
+		static constexpr std::size_t PROBE_WINDOW = 8;
+
+		struct Bucket
+		{
+			std::uint64_t key = 0; // 0 = empty
+			float tokens;
+			std::uint32_t last_seen; // milliseconds since m_Epoch
+		};
+
+		Config m_Config;
+		std::vector<Bucket> m_Buckets;
+		std::size_t m_Mask;
+		SteadyClock::time_point m_Epoch;
+		Stats m_Stats{};
+
+	public:
+		explicit Admission(Config config);
+
+		bool enabled() const noexcept { return m_Config.rate > 0; }
+		auto& config() const noexcept { return m_Config; }
+		auto& stats() const noexcept { return m_Stats; }
+
+		// consumes a token of the source, returns false if its bucket is empty
+		bool Admit(const boost::asio::ip::address& address, SteadyClock::time_point now = SteadyClock::now());
+	};
+}
+
+#endif
\ No newline at end of file
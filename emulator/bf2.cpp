@@ -1,6 +1,10 @@
 #include "bf2.h"
 #include <print>
 #include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 using namespace gamespy;
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
@@ -125,14 +129,23 @@ const auto bf2Data = GameData{
 	}
 };
 
-BF2::BF2(net::io_context& context)
-	: Game{ bf2Data }, m_Conn{ context }
+namespace {
+	GameData bf2_data(GameData::Storage storage)
+	{
+		auto data = bf2Data;
+		data.storage = storage;
+		return data;
+	}
+}
+
+BF2::BF2(net::io_context& context, GameData::Storage storage)
+	: Game{ ::bf2_data(storage) }, m_Conn{ context }, m_RankedServersLoaded{ context, net::steady_timer::time_point::max() }
 {
 
 }
 
-BF2::BF2(net::io_context& context, boost::mysql::connect_params params)
-	: Game{ bf2Data }, m_Conn{ context }, m_Params(std::move(params))
+BF2::BF2(net::io_context& context, boost::mysql::connect_params params, GameData::Storage storage)
+	: Game{ ::bf2_data(storage) }, m_Conn{ context }, m_Params(std::move(params)), m_RankedServersLoaded{ context, net::steady_timer::time_point::max() }
 {
 
 }
@@ -153,84 +166,182 @@ task<void> BF2::Connect()
 
 	std::println("[bf2] connecting to {}:{} db={}", std::string(m_Params->server_address.hostname()), m_Params->server_address.port(), m_Params->database);
 	co_await m_Conn.async_connect(*m_Params);
+	co_await LoadRankedServers();
+
+	const auto& executor = co_await net::this_coro::executor;
+	m_RankedServersTimer.emplace(executor);
+	net::co_spawn(executor, RefreshRankedServers(), net::detached);
 }
 
 task<void> BF2::Disconnect()
 {
+	if (m_RankedServersTimer)
+		m_RankedServersTimer->cancel();
+
+	co_await Game::Disconnect();
 	co_await m_Conn.async_close(net::use_awaitable);
 }
 
-task<void> BF2::AddOrUpdateServer(IncomingServer& server)
+task<void> BF2::Refresh()
 {
-	// TODO: implement ranked + plasma verification here
-	co_await Game::AddOrUpdateServer(server);
+	co_await Game::Refresh();
+	if (m_Params && !co_await LoadRankedServers())
+		throw std::runtime_error{ "failed to load the ranked servers" };
 }
 
-task<std::vector<Game::SavedServer>> BF2::GetServers(const std::string_view& _query, const std::vector<std::string_view>& fields, std::size_t limit, std::size_t skip)
+task<bool> BF2::LoadRankedServers()
 {
-	std::string_view query = _query;
-	std::string copy;
-
-	// remove all filters, "update server list", check any settings, "update server list"
-	// => the gametype selection will be concatenated to rest of the query, e.g. bf2_ranked = 1gametype like '%gpcm_cq%'
-	if (auto pos = query.find("gametype"); pos != std::string_view::npos && pos > 0 && query[pos - 1] != ' ') {
-		copy.assign(query);
-		copy.insert(pos, " and ");
-		query = copy;
-	}
+	// the connection does not support concurrent queries (a refresh requested via the admin api might overlap the timer).
+	// an overlapping call waits for the running load and then loads again: the running load might have read the
+	// servers before they were changed, so only a load started by this call returns fresh data
+	while (m_LoadingRankedServers)
+		co_await m_RankedServersLoaded.async_wait(net::as_tuple(net::use_awaitable));
+
+	m_LoadingRankedServers = true;
+
+	auto loaded = false;
+	try {
+		auto stmt = co_await m_Conn.async_prepare_statement(R"(
+			SELECT
+				server.ip as ip,
+				server.queryport as port,
+				stats_provider.plasma as plasma
+			FROM server
+			JOIN stats_provider ON stats_provider.id = server.provider_id
+			WHERE stats_provider.authorized = 1
+		)", net::use_awaitable);
+
+		boost::mysql::results result;
+		co_await m_Conn.async_execute(stmt.bind(), result, net::use_awaitable);
 
-	// fix unescaped single quotes in hostname queries
-	auto hostnameQuery = std::string_view{ "hostname like '%" };
-	if (auto pos = query.find(hostnameQuery); pos != std::string_view::npos) {
-		pos += hostnameQuery.size();
-		auto end = query.find("%'", pos);
-		if (end != std::string_view::npos) {
-			copy.assign(query);
-			for (; pos < end; pos++) {
-				if (copy[pos] == '\'') {
-					copy.insert(pos, "'");
-					pos++; // skip the character we just inserted
-					end++;
-				}
+		auto rankedServers = EndpointTable<bool>{ result.rows().size() * 2 };
+		for (const auto& row : result.rows()) {
+			auto error = boost::system::error_code{};
+			const auto address = net::ip::make_address_v4(row.at(0).as_string(), error);
+			const auto port = static_cast<std::uint16_t>(row.at(1).as_uint64());
+			if (error || port == 0) {
+				std::println(std::cerr, "[bf2] ignoring ranked server with invalid address {}:{}", row.at(0).as_string(), port);
+				continue;
 			}
-			query = copy;
+
+			*rankedServers.try_emplace(endpoint_key(address, port)).first = !!row.at(2).as_int64();
+		}
+
+		// the registered servers whose state changed (their stored values are used by the filters and indexes)
+		auto changed = std::vector<EndpointKey>{};
+		rankedServers.for_each([&](EndpointKey key, bool plasma) {
+			if (const auto previous = m_RankedServers.find(key); !previous || *previous != plasma)
+				changed.push_back(key);
+		});
+
+		m_RankedServers.for_each([&](EndpointKey key, bool) {
+			if (!rankedServers.find(key))
+				changed.push_back(key);
+		});
+
+		m_RankedServers = std::move(rankedServers);
+		loaded = true;
+
+		// stored again with the new state (stamped by AddOrUpdateServer)
+		for (const auto& key : changed) {
+			const auto endpoint = endpoint_from_key(key);
+			auto stored = co_await Game::GetServer(endpoint.address().to_string(), endpoint.port());
+			if (!stored)
+				continue;
+
+			auto server = IncomingServer{
+				.last_update = stored->last_update,
+				.public_ip = stored->public_ip,
+				.public_port = stored->public_port
+			};
+
+			for (const auto& [name, value] : stored->data)
+				server.data.emplace(name, value);
+
+			co_await AddOrUpdateServer(server);
 		}
 	}
+	catch (const std::exception& e) {
+		// the previous servers are kept
+		std::println(std::cerr, "[bf2] failed to load the ranked servers: {}", e.what());
+	}
+
+	m_LoadingRankedServers = false;
+	m_RankedServersLoaded.cancel();
+	co_return loaded;
+}
 
-	auto servers = co_await Game::GetServers(query, fields, limit, skip);
-	if (!m_Params || servers.size() == 0)
-		co_return servers;
-
-	auto stmt = co_await m_Conn.async_prepare_statement(R"(
-		SELECT
-			server.ip as ip,
-			server.queryport as port,
-			stats_provider.plasma as plasma
-		FROM server
-		JOIN stats_provider ON stats_provider.id = server.provider_id
-		WHERE stats_provider.authorized = 1
-	)", net::use_awaitable);
-
-	boost::mysql::results result;
-	co_await m_Conn.async_execute(stmt.bind(), result, net::use_awaitable);
-	auto rankedServers = std::map<std::pair<std::string, std::uint16_t>, bool>{};
-	for (const auto& row : result.rows()) {
-		auto conn = std::make_pair(row.at(0).as_string(), static_cast<std::uint16_t>(row.at(1).as_uint64()));
-		rankedServers.emplace(conn, !!row.at(2).as_int64());
+task<void> BF2::RefreshRankedServers()
+{
+	auto& timer = *m_RankedServersTimer;
+	while (true) {
+		timer.expires_after(RANKED_SERVERS_INTERVAL);
+		auto [error] = co_await timer.async_wait(net::as_tuple(net::use_awaitable));
+		if (error)
+			break;
+
+		co_await LoadRankedServers();
 	}
+}
 
-	for (auto& server : servers) {
-		auto conn = std::make_pair(server.public_ip, server.public_port);
-		auto iter = rankedServers.find(conn);
-		if (iter != rankedServers.end()) {
-			server.data["bf2_ranked"] = "1";
-			server.data["bf2_plasma"] = iter->second ? "1" : "0";
-		}
-		else {
-			server.data["bf2_ranked"] = "0";
-			server.data["bf2_plasma"] = "0";
-		}
+std::optional<bool> BF2::FindRankedServer(const std::string_view& ip, std::uint16_t port) const
+{
+	auto error = boost::system::error_code{};
+	const auto address = net::ip::make_address_v4(ip, error);
+	if (error || port == 0)
+		return std::nullopt;
+
+	if (const auto plasma = m_RankedServers.find(endpoint_key(address, port)))
+		return *plasma;
+
+	return std::nullopt;
+}
+
+task<void> BF2::AddOrUpdateServer(IncomingServer& server)
+{
+	// the servers cannot claim to be ranked, only servers of authorized providers are
+	if (m_Params) {
+		const auto plasma = FindRankedServer(server.public_ip, server.public_port);
+		server.data["bf2_ranked"] = plasma ? "1" : "0";
+		server.data["bf2_plasma"] = plasma && *plasma ? "1" : "0";
 	}
 
-	co_return servers;
+	co_await Game::AddOrUpdateServer(server);
+}
+
+task<std::optional<Game::ServerCursor>> BF2::OpenServers(const std::string_view& query, const std::vector<std::string_view>& fields)
+{
+	// the missing "and" before the gametype selection and the unescaped quotes in hostname searches
+	// are handled by the filter parser (see ServerFilter)
+	auto cursor = co_await Game::OpenServers(query, fields);
+	if (!m_Params || !cursor)
+		co_return cursor;
+
+	// the stored values are from the last heartbeat, the providers might have changed since
+	cursor->OnServer([this](SavedServer& server) {
+		const auto plasma = FindRankedServer(server.public_ip, server.public_port);
+		server.data["bf2_ranked"] = plasma ? "1" : "0";
+		server.data["bf2_plasma"] = plasma && *plasma ? "1" : "0";
+	});
+
+	co_return cursor;
 }
+
+task<std::optional<Game::SavedServer>> BF2::GetServer(const std::string_view& ip, std::uint16_t port)
+{
+	auto server = co_await Game::GetServer(ip, port);
+	if (!m_Params || !server)
+		co_return server;
+
+	// appended after the stored values (of the last heartbeat), the clients keep the last value of a key
+	const auto plasma = FindRankedServer(ip, port);
+	for (const auto& [key, value] : { std::pair{ std::string_view{ "bf2_ranked" }, !!plasma }, std::pair{ std::string_view{ "bf2_plasma" }, plasma && *plasma } }) {
+		server->data[key] = value ? "1" : "0";
+		server->rules.append(key);
+		server->rules.push_back('\0');
+		server->rules.append(value ? "1" : "0");
+		server->rules.push_back('\0');
+	}
+
+	co_return server;
+}
\ No newline at end of file
@@ -4,7 +4,9 @@
 
 #include "game.h"
 #include "asio.h"
+#include "endpoint_table.h"
 #include <boost/mysql.hpp>
+#include <chrono>
 #include <optional>
 #include <string_view>
 
@@ -15,9 +17,17 @@ namespace gamespy
 		boost::mysql::any_connection m_Conn;
 		std::optional<boost::mysql::connect_params> m_Params;
 
+		// servers of the authorized stats providers (value: plasma), reloaded in the background
+		// so that neither the heartbeats nor the server lists wait for mysql
+		static constexpr std::chrono::seconds RANKED_SERVERS_INTERVAL{ 60 };
+		EndpointTable<bool> m_RankedServers;
+		std::optional<boost::asio::steady_timer> m_RankedServersTimer;
+		bool m_LoadingRankedServers = false;
+		boost::asio::steady_timer m_RankedServersLoaded; // never expires, cancelled whenever a load completes (wakes the overlapping loads)
+
 	public:
-		BF2(boost::asio::io_context& context);
-		BF2(boost::asio::io_context& context, boost::mysql::connect_params params);
+		BF2(boost::asio::io_context& context, GameData::Storage storage = GameData::Storage::native);
+		BF2(boost::asio::io_context& context, boost::mysql::connect_params params, GameData::Storage storage = GameData::Storage::native);
 		~BF2();
 
 		auto GetConnectionParams() const noexcept { return m_Params; }
@@ -25,8 +35,15 @@ namespace gamespy
 		virtual task<void> Connect() override;
 		virtual task<void> Disconnect() override;
 
+		virtual task<void> Refresh() override;
 		virtual task<void> AddOrUpdateServer(IncomingServer& server) override;
-		virtual task<std::vector<SavedServer>> GetServers(const std::string_view& query, const std::vector<std::string_view>& fields, std::size_t limit, std::size_t skip) override;
+		virtual task<std::optional<ServerCursor>> OpenServers(const std::string_view& query, const std::vector<std::string_view>& fields) override;
+		virtual task<std::optional<SavedServer>> GetServer(const std::string_view& ip, std::uint16_t port) override;
+
+	private:
+		task<bool> LoadRankedServers(); // false if the previous servers are kept
+		task<void> RefreshRankedServers();
+		std::optional<bool> FindRankedServer(const std::string_view& ip, std::uint16_t port) const; // plasma, nullopt if unranked
 	};
 }
 
@@ -0,0 +1,244 @@
+#include "datagram.h"
+#include <algorithm>
+#include <print>
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+using namespace gamespy;
+using boost::asio::ip::udp;
+
+DatagramBatch::DatagramBatch(udp::socket& socket)
+	: m_Socket{ socket }, m_ReceiveBuffer(MAX_BATCH_SIZE * MAX_DATAGRAM_SIZE), m_SendSignal{ socket.get_executor() }
+{
+	// the socket is only used for readiness notifications, the actual i/o is done without blocking
+	m_Socket.non_blocking(true);
+}
+
+DatagramBatch::~DatagramBatch()
+{
+
+}
+
+task<std::tuple<boost::system::error_code, std::span<DatagramBatch::Datagram>>> DatagramBatch::Receive()
+{
+	while (m_Socket.is_open()) {
+		const auto& [error] = co_await m_Socket.async_wait(udp::socket::wait_read, boost::asio::as_tuple);
+		if (error)
+			co_return std::make_tuple(error, std::span<Datagram>{});
+
+		auto ec = boost::system::error_code{};
+		auto count = ReceiveAvailable(ec);
+		if (ec)
+			co_return std::make_tuple(ec, std::span<Datagram>{});
+
+		// the socket may be readable without any datagram being available (e.g. checksum failures)
+		if (count)
+			co_return std::make_tuple(ec, std::span{ m_Received.data(), count });
+	}
+
+	co_return std::make_tuple(boost::system::error_code{ boost::asio::error::bad_descriptor }, std::span<Datagram>{});
+}
+
+void DatagramBatch::Send(const udp::endpoint& endpoint, std::span<const std::uint8_t> data)
+{
+	if (QueuedCount() >= MAX_QUEUED_DATAGRAMS || m_QueuedBytes + data.size() > MAX_QUEUED_BYTES) {
+		// back-pressure: the clients will retry (heartbeats, availability checks), so it is better to drop replies than to stop receiving
+		m_Stats.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	m_Queued.push_back(QueuedDatagram{
+		.endpoint = endpoint,
+		.offset = m_SendBuffer.size(),
+		.size = data.size()
+	});
+
+	m_SendBuffer.append_range(data);
+	m_QueuedBytes += data.size();
+
+	const auto queued = QueuedCount();
+	m_Stats.queued.store(queued, std::memory_order_relaxed);
+	if (queued > m_Stats.peakQueued.load(std::memory_order_relaxed))
+		m_Stats.peakQueued.store(queued, std::memory_order_relaxed);
+}
+
+void DatagramBatch::Flush()
+{
+	if (QueuedCount())
+		m_SendSignal.cancel();
+}
+
+task<void> DatagramBatch::RunSender()
+{
+	while (m_Socket.is_open()) {
+		if (!QueuedCount()) {
+			// the timer never expires on its own, Flush cancels it
+			m_SendSignal.expires_at(boost::asio::steady_timer::time_point::max());
+			co_await m_SendSignal.async_wait(boost::asio::as_tuple);
+			continue;
+		}
+
+		auto ec = boost::system::error_code{};
+		const auto sent = SendQueued(m_QueueHead, ec);
+		Complete(sent);
+		m_Stats.sent.fetch_add(sent, std::memory_order_relaxed);
+
+		if (ec == boost::asio::error::would_block) {
+			m_Stats.blocked.fetch_add(1, std::memory_order_relaxed);
+			const auto& [error] = co_await m_Socket.async_wait(udp::socket::wait_write, boost::asio::as_tuple);
+			if (error)
+				break;
+		}
+		else if (ec) {
+			// a single unreachable client must not prevent the other replies from being sent
+			const auto& datagram = m_Queued[m_QueueHead];
+			std::println("[udp] failed to send to {}:{}: {}", datagram.endpoint.address().to_string(), datagram.endpoint.port(), ec.message());
+			m_Stats.failed.fetch_add(1, std::memory_order_relaxed);
+			Complete(1);
+		}
+
+		Compact();
+	}
+}
+
+void DatagramBatch::Complete(std::size_t count)
+{
+	for (auto i = m_QueueHead; i < m_QueueHead + count; i++)
+		m_QueuedBytes -= m_Queued[i].size;
+
+	m_QueueHead += count;
+}
+
+void DatagramBatch::Compact()
+{
+	if (m_QueueHead == m_Queued.size()) {
+		m_Queued.clear();
+		m_SendBuffer.clear();
+		m_QueueHead = 0;
+		m_QueuedBytes = 0;
+	}
+	else if (m_QueueHead >= MAX_BATCH_SIZE && m_QueueHead * 2 >= m_Queued.size()) {
+		// amortized: at least half of the entries are removed
+		const auto sentBytes = m_Queued[m_QueueHead].offset;
+		m_SendBuffer.erase(m_SendBuffer.begin(), m_SendBuffer.begin() + sentBytes);
+		m_Queued.erase(m_Queued.begin(), m_Queued.begin() + m_QueueHead);
+		for (auto& datagram : m_Queued)
+			datagram.offset -= sentBytes;
+
+		m_QueueHead = 0;
+	}
+
+	m_Stats.queued.store(QueuedCount(), std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+std::size_t DatagramBatch::ReceiveAvailable(boost::system::error_code& ec)
+{
+	auto headers = std::array<mmsghdr, MAX_BATCH_SIZE>{};
+	auto vectors = std::array<iovec, MAX_BATCH_SIZE>{};
+	for (std::size_t i = 0; i < MAX_BATCH_SIZE; i++) {
+		auto& datagram = m_Received[i];
+		datagram.endpoint = udp::endpoint{};
+
+		vectors[i].iov_base = m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE;
+		vectors[i].iov_len = MAX_DATAGRAM_SIZE;
+		headers[i].msg_hdr.msg_name = datagram.endpoint.data();
+		headers[i].msg_hdr.msg_namelen = static_cast<socklen_t>(datagram.endpoint.capacity());
+		headers[i].msg_hdr.msg_iov = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	auto received = ::recvmmsg(m_Socket.native_handle(), headers.data(), MAX_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+	if (received < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			ec.assign(errno, boost::system::system_category());
+
+		return 0;
+	}
+
+	auto count = std::size_t{ 0 };
+	for (std::size_t i = 0; i < static_cast<std::size_t>(received); i++) {
+		if (headers[i].msg_len == 0)
+			continue; // empty datagrams carry no packet
+
+		auto& datagram = m_Received[count++];
+		if (count - 1 != i)
+			datagram.endpoint = m_Received[i].endpoint;
+
+		datagram.endpoint.resize(headers[i].msg_hdr.msg_namelen);
+		datagram.data = std::span{ m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE, headers[i].msg_len };
+	}
+
+	return count;
+}
+
+std::size_t DatagramBatch::SendQueued(std::size_t offset, boost::system::error_code& ec)
+{
+	auto headers = std::array<mmsghdr, MAX_BATCH_SIZE>{};
+	auto vectors = std::array<iovec, MAX_BATCH_SIZE>{};
+	auto count = std::min(MAX_BATCH_SIZE, m_Queued.size() - offset);
+	for (std::size_t i = 0; i < count; i++) {
+		auto& datagram = m_Queued[offset + i];
+		vectors[i].iov_base = m_SendBuffer.data() + datagram.offset;
+		vectors[i].iov_len = datagram.size;
+		headers[i].msg_hdr.msg_name = datagram.endpoint.data();
+		headers[i].msg_hdr.msg_namelen = static_cast<socklen_t>(datagram.endpoint.size());
+		headers[i].msg_hdr.msg_iov = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	auto sent = ::sendmmsg(m_Socket.native_handle(), headers.data(), static_cast<unsigned int>(count), MSG_DONTWAIT);
+	if (sent < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			ec = boost::asio::error::would_block;
+		else
+			ec.assign(errno, boost::system::system_category());
+
+		return 0;
+	}
+
+	return static_cast<std::size_t>(sent);
+}
+#else
+std::size_t DatagramBatch::ReceiveAvailable(boost::system::error_code& ec)
+{
+	auto count = std::size_t{ 0 };
+	while (count < MAX_BATCH_SIZE) {
+		auto& datagram = m_Received[count];
+		auto buffer = boost::asio::buffer(m_ReceiveBuffer.data() + count * MAX_DATAGRAM_SIZE, MAX_DATAGRAM_SIZE);
+		auto length = m_Socket.receive_from(buffer, datagram.endpoint, 0, ec);
+		if (ec == boost::asio::error::connection_reset || ec == boost::asio::error::connection_refused) {
+			// windows reports icmp port unreachable messages of previous sends on the next receive
+			ec.clear();
+			continue;
+		}
+		else if (ec == boost::asio::error::would_block) {
+			ec.clear();
+			break;
+		}
+		else if (ec)
+			break;
+		else if (length == 0)
+			continue;
+
+		datagram.data = std::span{ m_ReceiveBuffer.data() + count * MAX_DATAGRAM_SIZE, length };
+		count++;
+	}
+
+	return count;
+}
+
+std::size_t DatagramBatch::SendQueued(std::size_t offset, boost::system::error_code& ec)
+{
+	auto sent = std::size_t{ 0 };
+	for (auto i = offset; i < m_Queued.size(); i++, sent++) {
+		const auto& datagram = m_Queued[i];
+		m_Socket.send_to(boost::asio::buffer(m_SendBuffer.data() + datagram.offset, datagram.size), datagram.endpoint, 0, ec);
+		if (ec)
+			break;
+	}
+
+	return sent;
+}
+#endif
\ No newline at end of file
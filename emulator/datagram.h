@@ -0,0 +1,97 @@
+#pragma once
+#ifndef _GAMESPY_DATAGRAM_H_
+#define _GAMESPY_DATAGRAM_H_
+
+#include "asio.h"
+#include "task.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <tuple>
+#include <vector>
+
+namespace gamespy {
+	// batched datagram i/o for the udp servers:
+	// Receive waits until the socket becomes readable and then drains up to MAX_BATCH_SIZE datagrams at once (recvmmsg),
+	// replies are queued with Send and written with as few syscalls as possible by the sender coroutine (sendmmsg), which
+	// is woken up by Flush. the receiving side therefore never waits for a send to complete: if the socket is not writable
+	// only the sender waits, and once the queue is full further replies are dropped (see Stats).
+	// platforms without recvmmsg/sendmmsg fall back to non-blocking receive_from/send_to loops
+	class DatagramBatch
+	{
+	public:
+		static constexpr std::size_t MAX_BATCH_SIZE = 64;
+		static constexpr std::size_t MAX_DATAGRAM_SIZE = 1400;
+		static constexpr std::size_t MAX_QUEUED_DATAGRAMS = 4096;
+		static constexpr std::size_t MAX_QUEUED_BYTES = 1024 * 1024;
+
+		struct Stats
+		{
+			std::atomic<std::uint64_t> sent;
+			std::atomic<std::uint64_t> dropped; // queue was full
+			std::atomic<std::uint64_t> failed; // rejected by the socket (e.g. unreachable)
+			std::atomic<std::uint64_t> blocked; // times the sender had to wait for the socket to become writable
+			std::atomic<std::size_t> queued;
+			std::atomic<std::size_t> peakQueued;
+		};
+
+		struct Datagram
+		{
+			boost::asio::ip::udp::endpoint endpoint;
+			std::span<std::uint8_t> data;
+		};
+
+	private:
+		struct QueuedDatagram
+		{
+			boost::asio::ip::udp::endpoint endpoint;
+			std::size_t offset;
+			std::size_t size;
+		};
+
+		boost::asio::ip::udp::socket& m_Socket;
+		std::vector<std::uint8_t> m_ReceiveBuffer; // MAX_BATCH_SIZE * MAX_DATAGRAM_SIZE
+		std::array<Datagram, MAX_BATCH_SIZE> m_Received;
+		std::vector<std::uint8_t> m_SendBuffer;
+		std::vector<QueuedDatagram> m_Queued; // points to m_SendBuffer
+		std::size_t m_QueueHead = 0; // m_Queued[0, m_QueueHead) were already sent
+		std::size_t m_QueuedBytes = 0; // size of m_Queued[m_QueueHead, end), m_SendBuffer also holds sent but not yet compacted bytes
+		boost::asio::steady_timer m_SendSignal; // cancelled to wake up the sender
+		Stats m_Stats{};
+
+	public:
+		DatagramBatch(boost::asio::ip::udp::socket& socket);
+		~DatagramBatch();
+
+		// the returned datagrams are valid until the next call to Receive
+		task<std::tuple<boost::system::error_code, std::span<Datagram>>> Receive();
+
+		void Send(const boost::asio::ip::udp::endpoint& endpoint, std::span<const std::uint8_t> data);
+
+		template<class R> requires std::ranges::contiguous_range<R> && (sizeof(std::ranges::range_value_t<R>) == 1)
+		void Send(const boost::asio::ip::udp::endpoint& endpoint, const R& data)
+		{
+			Send(endpoint, std::span{ reinterpret_cast<const std::uint8_t*>(std::ranges::data(data)), std::ranges::size(data) });
+		}
+
+		// wakes up the sender, does not wait for the queued datagrams to be sent
+		void Flush();
+
+		// sends the queued datagrams until the socket is closed
+		task<void> RunSender();
+
+		auto& stats() const noexcept { return m_Stats; }
+
+	private:
+		std::size_t QueuedCount() const noexcept { return m_Queued.size() - m_QueueHead; }
+		void Complete(std::size_t count);
+		void Compact();
+		std::size_t ReceiveAvailable(boost::system::error_code& ec);
+		std::size_t SendQueued(std::size_t offset, boost::system::error_code& ec);
+	};
+}
+
+#endif
\ No newline at end of file
@@ -12,13 +12,51 @@
 #include "bf2.h"
 #include "utils.h"
 #include "http.h"
+#include <algorithm>
 #include <print>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 
 using namespace gamespy;
 
+namespace {
+	std::map<std::string, std::uint64_t> to_map(const Admission::Stats& admission)
+	{
+		return {
+			{ "admitted", admission.admitted.load(std::memory_order_relaxed) },
+			{ "dropped", admission.dropped.load(std::memory_order_relaxed) },
+			{ "evicted", admission.evicted.load(std::memory_order_relaxed) }
+		};
+	}
+
+	std::map<std::string, std::uint64_t> to_map(const BrowserServer::PushStats& updates)
+	{
+		return {
+			{ "updates_sent", updates.sent.load(std::memory_order_relaxed) },
+			{ "updates_coalesced", updates.coalesced.load(std::memory_order_relaxed) },
+			{ "updates_dropped", updates.dropped.load(std::memory_order_relaxed) },
+			{ "slow_clients_disconnected", updates.disconnected.load(std::memory_order_relaxed) }
+		};
+	}
+
+	std::map<std::string, std::uint64_t> to_map(const Admission::Stats& admission, const DatagramBatch::Stats& replies)
+	{
+		auto stats = to_map(admission);
+		stats.insert({
+			{ "replies_sent", replies.sent.load(std::memory_order_relaxed) },
+			{ "replies_dropped", replies.dropped.load(std::memory_order_relaxed) },
+			{ "replies_failed", replies.failed.load(std::memory_order_relaxed) },
+			{ "replies_blocked", replies.blocked.load(std::memory_order_relaxed) },
+			{ "replies_queued", replies.queued.load(std::memory_order_relaxed) },
+			{ "replies_peak_queued", replies.peakQueued.load(std::memory_order_relaxed) }
+		});
+
+		return stats;
+	}
+}
+
 Emulator::Emulator(boost::asio::io_context& context)
 	: m_Context(context)
 {
@@ -27,7 +65,18 @@ Emulator::Emulator(boost::asio::io_context& context)
 
 Emulator::~Emulator()
 {
+	// the additional master shards run on their own threads
+	for (auto& context : m_MasterContexts)
+		context->stop();
 
+	m_MasterThreads.clear();
+
+	// the shards are not running anymore, so their servers can be collected directly
+	if (m_MasterSnapshot)
+		m_MasterSnapshot->Save();
+
+	m_MasterServers.clear();
+	m_MasterSnapshot.reset();
 }
 
 task<void> Emulator::Launch(int argc, char* argv[])
@@ -38,6 +87,7 @@ task<void> Emulator::Launch(int argc, char* argv[])
 			std::println("Allowed options:");
 			std::println("-h [--help]              : produces this message");
 			std::println("-gamedb=<stdin|path>     : use game-database (json) from standard input or filepath");
+			std::println("-server-store=<type>     : table of the registered servers: native or sqlite (default: native)");
 			std::println("-playerdb=<sqlite3-file> : use given file as player database");
 			std::println("-playerdb-host           : mysql hostname for player database (bf2stats compatible)");
 			std::println("-playerdb-port           : mysql port (default: 3306)");
@@ -45,6 +95,20 @@ task<void> Emulator::Launch(int argc, char* argv[])
 			std::println("-playerdb-password       : the user's password");
 			std::println("-playerdb-database       : the database name for the player database");
 			std::println();
+			std::println("-master-threads=<n>      : number of threads receiving heartbeats (default: 1)");
+			std::println("Note: more than one thread requires SO_REUSEPORT (not available on windows)");
+			std::println("-master-snapshot=<path>  : saves the validated servers periodically and restores them on startup");
+			std::println("Note: the file is shared by all threads, the servers are restored independent of their number");
+			std::println();
+			std::println("Admission control (per source ip, 0 = unlimited):");
+			std::println("-udp-rate=<n>            : datagrams per second (default: 0)");
+			std::println("-udp-burst=<n>           : datagrams which can be sent at once (default: the rate)");
+			std::println("-tcp-rate=<n>            : connections per second (default: 0)");
+			std::println("-tcp-burst=<n>           : connections which can be opened at once (default: the rate)");
+			std::println("Note: the udp limits apply per master thread");
+			std::println("Note: hosting providers run many game servers behind one ip, each server sends a heartbeat");
+			std::println("      every few seconds and answers the challenge (e.g. -udp-rate=500 -udp-burst=2000)");
+			std::println();
 			std::println("Stats server options:");
 			std::println("-stats-host              : the snapshot server host (bf2stats)");
 			std::println("-stats-port              : the snapshot server host port (bf2stats)");
@@ -65,16 +129,28 @@ task<void> Emulator::Launch(int argc, char* argv[])
 
 	co_await InitGameDB(argc, argv);
 	co_await InitPlayerDB(argc, argv);
+	co_await InitAdmission(argc, argv);
 	co_await InitAdminServer(argc, argv);
 	co_await InitStatsServer(argc, argv);
 	co_await InitHttpServer(argc, argv);
 
-	m_MasterServer = std::make_unique<MasterServer>(m_Context, *m_GameDB);
-	m_LoginServer = std::make_unique<LoginServer>(m_Context, *m_GameDB, *m_PlayerDB);
-	m_SearchServer = std::make_unique<SearchServer>(m_Context, *m_PlayerDB);
-	m_BrowserServer = std::make_unique<BrowserServer>(m_Context, *m_GameDB);
+	co_await InitMasterServer(argc, argv);
+	m_LoginServer = std::make_unique<LoginServer>(m_Context, *m_TcpAdmission, *m_GameDB, *m_PlayerDB);
+	m_SearchServer = std::make_unique<SearchServer>(m_Context, *m_TcpAdmission, *m_PlayerDB);
+	m_BrowserServer = std::make_unique<BrowserServer>(m_Context, *m_TcpAdmission, *m_GameDB);
 	// cd-key server doesn't need db support as we accept all keys
-	m_CDKeyServer = std::make_unique<CDKeyServer>(m_Context);
+	m_CDKeyServer = std::make_unique<CDKeyServer>(m_Context, m_UdpAdmission);
+
+	if (m_AdminServer) {
+		// the counters are atomics, so they can be read while the master shards are running on their own threads
+		m_AdminServer->AddStatsProvider("tcp", [this]() { return ::to_map(m_TcpAdmission->stats()); });
+		m_AdminServer->AddStatsProvider("browser", [this]() { return ::to_map(m_BrowserServer->pushStats()); });
+		m_AdminServer->AddStatsProvider("cd-key", [this]() { return ::to_map(m_CDKeyServer->admissionStats(), m_CDKeyServer->replyStats()); });
+		for (std::size_t i = 0; i < m_MasterServers.size(); i++) {
+			const auto& master = *m_MasterServers[i];
+			m_AdminServer->AddStatsProvider(std::format("master:{}", i), [&master]() { return ::to_map(master.admissionStats(), master.replyStats()); });
+		}
+	}
 
 	using namespace boost::asio::experimental::awaitable_operators;
 	auto wrap = [](const std::string_view& name, task<void>&& coro) -> task<void>
@@ -90,8 +166,28 @@ task<void> Emulator::Launch(int argc, char* argv[])
 
 	auto noop = []() -> task<void> { co_return; };
 
+	// the restored servers are registered in their games before the first datagram is received (they are queued by the sockets)
+	if (m_MasterSnapshot)
+		co_await m_MasterSnapshot->Load();
+
+	for (std::size_t i = 1; i < m_MasterServers.size(); i++) {
+		auto& context = *m_MasterContexts[i - 1];
+		boost::asio::co_spawn(context, m_MasterServers[i]->Run(), [i](std::exception_ptr ex) {
+			if (!ex) return;
+			try {
+				std::rethrow_exception(ex);
+			}
+			catch (const std::exception& e) {
+				std::println(std::cerr, "[master:{}][fatal] {}", i, e.what());
+			}
+		});
+
+		m_MasterThreads.emplace_back([&context]() { context.run(); });
+	}
+
 	co_await (
-		wrap("master", m_MasterServer->Run())
+		wrap("master", m_MasterServers.front()->Run())
+		&& wrap("snapshot", m_MasterSnapshot ? m_MasterSnapshot->Run() : noop())
 		&& wrap("login", m_LoginServer->AcceptClients())
 		&& wrap("search", m_SearchServer->AcceptClients())
 		&& wrap("browser", m_BrowserServer->AcceptClients())
@@ -107,6 +203,20 @@ task<void> Emulator::Launch(int argc, char* argv[])
 
 task<void> Emulator::InitGameDB(int argc, char* argv[])
 {
+	auto storage = GameData::Storage::native;
+	for (int i = 0; i < argc; i++) {
+		auto arg = std::string_view{ argv[i] };
+		if (arg.starts_with("-server-store=")) {
+			auto store = arg.substr(14);
+			if (store == "native")
+				storage = GameData::Storage::native;
+			else if (store == "sqlite")
+				storage = GameData::Storage::sqlite;
+			else
+				std::println("[gamedb] unknown server store {}, using native", store);
+		}
+	}
+
 	for (int i = 0; i < argc; i++) {
 		auto arg = std::string_view{ argv[i] };
 		if (arg.starts_with("-gamedb=")) {
@@ -114,11 +224,11 @@ task<void> Emulator::InitGameDB(int argc, char* argv[])
 			if (filename == "stdin") {
 				std::ostringstream oss;
 				oss << std::cin.rdbuf();  // Blocks until EOF (Ctrl+D on Unix, Ctrl+Z on Windows)
-				m_GameDB = std::make_unique<GameDBInMemory>(m_Context, nlohmann::json::parse(oss.str()));
+				m_GameDB = std::make_unique<GameDBInMemory>(m_Context, storage, nlohmann::json::parse(oss.str()));
 			}
 			else {
 				auto file = std::ifstream{ filename.data() };
-				m_GameDB = std::make_unique<GameDBInMemory>(m_Context, nlohmann::json::parse(file));
+				m_GameDB = std::make_unique<GameDBInMemory>(m_Context, storage, nlohmann::json::parse(file));
 			}
 
 			break;
@@ -127,7 +237,7 @@ task<void> Emulator::InitGameDB(int argc, char* argv[])
 
 	if (!m_GameDB) {
 		std::println("[gamedb] no gamedb configured, using fallback");
-		m_GameDB = std::make_unique<GameDBInMemory>(m_Context);
+		m_GameDB = std::make_unique<GameDBInMemory>(m_Context, storage);
 	}
 
 	co_await m_GameDB->Connect();
@@ -190,6 +300,76 @@ task<void> Emulator::InitPlayerDB(int argc, char* argv[])
 	co_await m_PlayerDB->Connect();
 }
 
+task<void> Emulator::InitAdmission(int argc, char* argv[])
+{
+	// disabled by default: a fixed limit would throttle the hosting providers (many servers behind one address)
+	m_UdpAdmission = Admission::Config{};
+	auto tcp = Admission::Config{};
+	for (int i = 0; i < argc; i++) {
+		auto arg = std::string_view{ argv[i] };
+		if (arg.starts_with("-udp-rate="))
+			m_UdpAdmission.rate = std::atof(arg.substr(10).data());
+		else if (arg.starts_with("-udp-burst="))
+			m_UdpAdmission.burst = std::atof(arg.substr(11).data());
+		else if (arg.starts_with("-tcp-rate="))
+			tcp.rate = std::atof(arg.substr(10).data());
+		else if (arg.starts_with("-tcp-burst="))
+			tcp.burst = std::atof(arg.substr(11).data());
+	}
+
+	// without a burst size no token would ever be available
+	for (auto* config : { &m_UdpAdmission, &tcp }) {
+		if (config->burst < 1)
+			config->burst = std::max(config->rate, 1.0);
+	}
+
+	m_TcpAdmission = std::make_unique<Admission>(tcp);
+	co_return;
+}
+
+task<void> Emulator::InitMasterServer(int argc, char* argv[])
+{
+	std::size_t threads = 1;
+	auto snapshot = std::optional<std::filesystem::path>{};
+	for (int i = 0; i < argc; i++) {
+		auto arg = std::string_view{ argv[i] };
+		if (arg.starts_with("-master-threads="))
+			threads = std::max(1, std::atoi(arg.substr(16).data()));
+		else if (arg.starts_with("-master-snapshot=") && arg.size() > 17)
+			snapshot = arg.substr(17);
+	}
+
+#ifndef SO_REUSEPORT
+	if (threads > 1) {
+		std::println("[master] SO_REUSEPORT is not supported, falling back to a single thread");
+		threads = 1;
+	}
+#endif
+
+	// each shard has its own socket and io_context, but the games are only accessed from the main context
+	const auto shared = threads > 1;
+
+	// a single snapshot for all shards: the restored servers are claimed by the shard which receives their datagrams
+	if (snapshot)
+		m_MasterSnapshot = std::make_unique<MasterSnapshot>(m_Context, *m_GameDB, *snapshot);
+
+	m_MasterServers.push_back(std::make_unique<MasterServer>(m_Context, m_UdpAdmission, *m_GameDB, m_Context.get_executor(), shared, m_MasterSnapshot.get()));
+	for (std::size_t i = 1; i < threads; i++) {
+		auto& context = *m_MasterContexts.emplace_back(std::make_unique<boost::asio::io_context>(1));
+		m_MasterServers.push_back(std::make_unique<MasterServer>(context, m_UdpAdmission, *m_GameDB, m_Context.get_executor(), shared, m_MasterSnapshot.get()));
+	}
+
+	if (m_MasterSnapshot) {
+		for (auto& master : m_MasterServers)
+			m_MasterSnapshot->AddShard(*master);
+	}
+
+	if (shared)
+		std::println("[master] running {} shards", threads);
+
+	co_return;
+}
+
 task<void> Emulator::InitAdminServer(int argc, char* argv[])
 {
 	std::string username;
@@ -212,7 +392,7 @@ task<void> Emulator::InitAdminServer(int argc, char* argv[])
 		}
 	}
 
-	m_AdminServer = std::make_unique<AdminServer>(m_Context, *m_GameDB, *m_PlayerDB, username, password, port);
+	m_AdminServer = std::make_unique<AdminServer>(m_Context, *m_TcpAdmission, *m_GameDB, *m_PlayerDB, username, password, port);
 	co_return;
 }
 
@@ -236,7 +416,7 @@ task<void> Emulator::InitStatsServer(int argc, char* argv[])
 	if (!host.empty() && port)
 		snapshotEndpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(host), *port);
 
-	m_StatsServer = std::make_unique<StatsServer>(m_Context, *m_GameDB, *m_PlayerDB, snapshotEndpoint);
+	m_StatsServer = std::make_unique<StatsServer>(m_Context, *m_TcpAdmission, *m_GameDB, *m_PlayerDB, snapshotEndpoint);
 	co_return;
 }
 
@@ -245,7 +425,7 @@ task<void> Emulator::InitHttpServer(int argc, char* argv[])
 	for (int i = 0; i < argc; i++) {
 		auto arg = std::string_view{ argv[i] };
 		if (arg == "-http-enabled" || arg == "-http-enabled=true") {
-			m_HttpServer = std::make_unique<HttpServer>(m_Context, *m_GameDB, *m_PlayerDB);
+			m_HttpServer = std::make_unique<HttpServer>(m_Context, *m_TcpAdmission, *m_GameDB, *m_PlayerDB);
 			std::println("[http] enabled");
 			break;
 		}
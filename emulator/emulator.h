@@ -3,13 +3,17 @@
 #define _GAMESPY_EMULATOR_H_
 #include "asio.h"
 #include "task.h"
+#include "admission.h"
 #include <memory>
+#include <thread>
+#include <vector>
 
 namespace gamespy
 {
 	class GameDB;
 	class PlayerDB;
 	class MasterServer;
+	class MasterSnapshot;
 	class LoginServer;
 	class SearchServer;
 	class BrowserServer;
@@ -22,7 +26,12 @@ namespace gamespy
 		boost::asio::io_context& m_Context;
 		std::unique_ptr<GameDB> m_GameDB;
 		std::unique_ptr<PlayerDB> m_PlayerDB;
-		std::unique_ptr<MasterServer> m_MasterServer;
+		Admission::Config m_UdpAdmission; // every udp server (master shard, cd-key) has its own instance
+		std::unique_ptr<Admission> m_TcpAdmission; // shared by all tcp servers (they run on m_Context)
+		std::vector<std::unique_ptr<boost::asio::io_context>> m_MasterContexts; // one per additional master shard
+		std::vector<std::unique_ptr<MasterServer>> m_MasterServers; // the first shard runs on m_Context
+		std::unique_ptr<MasterSnapshot> m_MasterSnapshot; // shared by the shards (optional)
+		std::vector<std::jthread> m_MasterThreads;
 		std::unique_ptr<LoginServer> m_LoginServer;
 		std::unique_ptr<SearchServer> m_SearchServer;
 		std::unique_ptr<BrowserServer> m_BrowserServer;
@@ -40,6 +49,8 @@ namespace gamespy
 	private:
 		task<void> InitGameDB(int argc, char* argv[]);
 		task<void> InitPlayerDB(int argc, char* argv[]);
+		task<void> InitAdmission(int argc, char* argv[]);
+		task<void> InitMasterServer(int argc, char* argv[]);
 		task<void> InitAdminServer(int argc, char* argv[]);
 		task<void> InitStatsServer(int argc, char* argv[]);
 		task<void> InitHttpServer(int argc, char* argv[]);
@@ -0,0 +1,166 @@
+#pragma once
+#ifndef _GAMESPY_ENDPOINT_TABLE_H_
+#define _GAMESPY_ENDPOINT_TABLE_H_
+
+#include "asio.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace gamespy {
+	// ipv4 address and port packed into the lower 48 bits: (ip << 16) | port
+	using EndpointKey = std::uint64_t;
+
+	inline EndpointKey endpoint_key(const boost::asio::ip::address_v4& address, std::uint16_t port) noexcept
+	{
+		return (static_cast<EndpointKey>(address.to_uint()) << 16) | port;
+	}
+
+	inline EndpointKey endpoint_key(const boost::asio::ip::udp::endpoint& endpoint)
+	{
+		return endpoint_key(endpoint.address().to_v4(), endpoint.port());
+	}
+
+	inline boost::asio::ip::udp::endpoint endpoint_from_key(EndpointKey key)
+	{
+		return {
+			boost::asio::ip::address_v4{ static_cast<std::uint32_t>(key >> 16) },
+			static_cast<std::uint16_t>(key & 0xFFFF)
+		};
+	}
+
+	// open-addressing hash table (linear probing, backward-shift deletion) keyed by packed endpoints.
+	// the values are stored inline with their keys, so a lookup touches a single cache line in the common case.
+	// pointers returned by find/try_emplace are invalidated by any call to try_emplace or erase
+	template<typename T>
+	class EndpointTable
+	{
+		// 0.0.0.0:0 is never the source address of a datagram
+		static constexpr EndpointKey EMPTY = 0;
+
+		struct Slot
+		{
+			EndpointKey key = EMPTY;
+			T value{};
+		};
+
+		std::vector<Slot> m_Slots;
+		std::size_t m_Size = 0;
+		std::size_t m_Mask;
+
+	public:
+		explicit EndpointTable(std::size_t capacity = 1024)
+			: m_Slots(std::bit_ceil(std::max<std::size_t>(capacity, 16))), m_Mask{ m_Slots.size() - 1 }
+		{
+
+		}
+
+		std::size_t size() const noexcept { return m_Size; }
+		std::size_t capacity() const noexcept { return m_Slots.size(); }
+		bool empty() const noexcept { return m_Size == 0; }
+
+		T* find(EndpointKey key) noexcept
+		{
+			for (auto i = Index(key); ; i = (i + 1) & m_Mask) {
+				auto& slot = m_Slots[i];
+				if (slot.key == key)
+					return &slot.value;
+				else if (slot.key == EMPTY)
+					return nullptr;
+			}
+		}
+
+		const T* find(EndpointKey key) const noexcept
+		{
+			return const_cast<EndpointTable*>(this)->find(key);
+		}
+
+		// returns the value for the given key and whether it was inserted (value-initialized) by this call
+		std::pair<T*, bool> try_emplace(EndpointKey key)
+		{
+			if (key == EMPTY)
+				throw std::invalid_argument{ "invalid endpoint key" };
+
+			// keep the load factor below 3/4 so that the probe sequences stay short
+			if ((m_Size + 1) * 4 > m_Slots.size() * 3)
+				Grow();
+
+			for (auto i = Index(key); ; i = (i + 1) & m_Mask) {
+				auto& slot = m_Slots[i];
+				if (slot.key == key)
+					return { &slot.value, false };
+				else if (slot.key == EMPTY) {
+					slot.key = key;
+					slot.value = T{};
+					m_Size++;
+					return { &slot.value, true };
+				}
+			}
+		}
+
+		bool erase(EndpointKey key) noexcept
+		{
+			auto i = Index(key);
+			while (m_Slots[i].key != key) {
+				if (m_Slots[i].key == EMPTY)
+					return false;
+
+				i = (i + 1) & m_Mask;
+			}
+
+			// shift the following entries of the probe sequence back, so that no tombstones are required
+			for (auto j = (i + 1) & m_Mask; m_Slots[j].key != EMPTY; j = (j + 1) & m_Mask) {
+				auto home = Index(m_Slots[j].key);
+				if (((j - home) & m_Mask) >= ((j - i) & m_Mask)) {
+					m_Slots[i] = std::move(m_Slots[j]);
+					i = j;
+				}
+			}
+
+			m_Slots[i].key = EMPTY;
+			m_Slots[i].value = T{};
+			m_Size--;
+			return true;
+		}
+
+		template<typename F>
+		void for_each(F&& f)
+		{
+			for (auto& slot : m_Slots) {
+				if (slot.key != EMPTY)
+					f(slot.key, slot.value);
+			}
+		}
+
+	private:
+		std::size_t Index(EndpointKey key) const noexcept
+		{
+			// fibonacci hashing spreads the (mostly sequential) ports over the whole table
+			return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & m_Mask;
+		}
+
+		void Grow()
+		{
+			auto slots = std::vector<Slot>(m_Slots.size() * 2);
+			std::swap(slots, m_Slots);
+			m_Mask = m_Slots.size() - 1;
+
+			for (auto& slot : slots) {
+				if (slot.key == EMPTY)
+					continue;
+
+				auto i = Index(slot.key);
+				while (m_Slots[i].key != EMPTY)
+					i = (i + 1) & m_Mask;
+
+				m_Slots[i] = std::move(slot);
+			}
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,510 @@
+#include "filter.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+using namespace gamespy;
+
+namespace {
+	constexpr std::size_t max_filter_depth = 64;
+
+	struct Token
+	{
+		enum class Type {
+			end,
+			identifier,
+			number,
+			string,
+			op,
+			open,
+			close
+		} type = Type::end;
+
+		std::string_view text;
+		std::string value; // unescaped string literal
+	};
+
+	bool iequals(const std::string_view& lhs, const std::string_view& rhs)
+	{
+		return std::ranges::equal(lhs, rhs, [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+	}
+
+	// sql like: % matches any sequence, _ any single character and letters are compared case insensitive
+	bool like(const std::string_view& text, const std::string_view& pattern)
+	{
+		auto lower = [](char c) { return std::tolower(static_cast<unsigned char>(c)); };
+		std::size_t t = 0, p = 0;
+		auto wildcard = std::string_view::npos;
+		auto resume = std::size_t{ 0 };
+		while (t < text.size()) {
+			if (p < pattern.size() && pattern[p] == '%') {
+				wildcard = p++;
+				resume = t;
+			}
+			else if (p < pattern.size() && (pattern[p] == '_' || lower(pattern[p]) == lower(text[t]))) {
+				p++;
+				t++;
+			}
+			else if (wildcard != std::string_view::npos) {
+				// let the last % consume one more character
+				p = wildcard + 1;
+				t = ++resume;
+			}
+			else
+				return false;
+		}
+
+		while (p < pattern.size() && pattern[p] == '%')
+			p++;
+
+		return p == pattern.size();
+	}
+
+	std::optional<double> to_number(const std::string_view& str)
+	{
+		auto value = double{};
+		const auto end = str.data() + str.size();
+		auto [ptr, ec] = std::from_chars(str.data(), end, value);
+		// from_chars accepts nan and inf, which are text for sqlite (and cannot be ordered)
+		if (ec != std::errc{} || ptr != end || str.empty() || !std::isfinite(value))
+			return std::nullopt;
+
+		return value;
+	}
+}
+
+class ServerFilter::Parser
+{
+	std::string_view m_Input;
+	std::size_t m_Pos = 0;
+	std::size_t m_Depth = 0;
+	const ColumnResolver& m_Resolve;
+	ServerFilter& m_Filter;
+
+public:
+	Token token;
+
+	Parser(const std::string_view& input, const ColumnResolver& resolve, ServerFilter& filter)
+		: m_Input{ input }, m_Resolve{ resolve }, m_Filter{ filter }
+	{
+
+	}
+
+	std::expected<void, ParseError> Next()
+	{
+		while (m_Pos < m_Input.size() && std::isspace(static_cast<unsigned char>(m_Input[m_Pos])))
+			m_Pos++;
+
+		token = Token{};
+		if (m_Pos == m_Input.size())
+			return {};
+
+		const auto start = m_Pos;
+		const auto c = m_Input[m_Pos];
+		auto isDigit = [&](std::size_t pos) { return pos < m_Input.size() && std::isdigit(static_cast<unsigned char>(m_Input[pos])); };
+		if (c == '(' || c == ')') {
+			token.type = c == '(' ? Token::Type::open : Token::Type::close;
+			m_Pos++;
+		}
+		else if (c == '\'' || c == '"') {
+			token.type = Token::Type::string;
+			if (auto error = ReadString(c); !error)
+				return error;
+		}
+		else if (isDigit(m_Pos) || ((c == '-' || c == '.') && (isDigit(m_Pos + 1) || (m_Input.substr(m_Pos, 2) == "-." && isDigit(m_Pos + 2))))) {
+			token.type = Token::Type::number;
+			m_Pos++;
+			while (isDigit(m_Pos) || (m_Pos < m_Input.size() && m_Input[m_Pos] == '.'))
+				m_Pos++;
+		}
+		else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+			token.type = Token::Type::identifier;
+			while (m_Pos < m_Input.size() && (std::isalnum(static_cast<unsigned char>(m_Input[m_Pos])) || m_Input[m_Pos] == '_'))
+				m_Pos++;
+		}
+		else {
+			token.type = Token::Type::op;
+			for (const auto& op : { "<=", ">=", "<>", "!=", "==", "=", "<", ">" }) {
+				if (m_Input.substr(m_Pos).starts_with(op)) {
+					m_Pos += std::string_view{ op }.size();
+					break;
+				}
+			}
+
+			if (m_Pos == start)
+				return std::unexpected(ParseError::unexpected_token);
+		}
+
+		token.text = m_Input.substr(start, m_Pos - start);
+		return {};
+	}
+
+	bool IsKeyword(const std::string_view& keyword) const
+	{
+		return token.type == Token::Type::identifier && ::iequals(token.text, keyword);
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseOr()
+	{
+		auto lhs = ParseAnd();
+		while (lhs && IsKeyword("or")) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+
+			auto rhs = ParseAnd();
+			if (!rhs)
+				return rhs;
+
+			lhs = AddNode(Op::op_or, *lhs, *rhs);
+		}
+
+		return lhs;
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseAnd()
+	{
+		auto lhs = ParseNot();
+		while (lhs) {
+			if (IsKeyword("and")) {
+				if (auto next = Next(); !next)
+					return std::unexpected(next.error());
+			}
+			else if (!StartsCondition())
+				break;
+			// else: conditions without and in between (bf2 concatenates the gametype selection, e.g. bf2_ranked = 1gametype like '%cq%')
+
+			auto rhs = ParseNot();
+			if (!rhs)
+				return rhs;
+
+			lhs = AddNode(Op::op_and, *lhs, *rhs);
+		}
+
+		return lhs;
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseNot()
+	{
+		if (++m_Depth > ::max_filter_depth)
+			return std::unexpected(ParseError::too_complex);
+
+		auto node = std::expected<std::uint32_t, ParseError>{};
+		if (IsKeyword("not")) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+
+			node = ParseNot();
+			if (node)
+				node = AddNode(Op::op_not, *node);
+		}
+		else
+			node = ParseCondition();
+
+		m_Depth--;
+		return node;
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseCondition()
+	{
+		if (token.type == Token::Type::open) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+
+			auto node = ParseOr();
+			if (!node)
+				return node;
+			else if (token.type != Token::Type::close)
+				return std::unexpected(ParseError::unexpected_token);
+
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+
+			return node;
+		}
+
+		auto lhs = ParseOperand();
+		if (!lhs)
+			return lhs;
+
+		auto op = Op::truthy;
+		if (token.type == Token::Type::op) {
+			const auto& text = token.text;
+			if (text == "=" || text == "==")
+				op = Op::eq;
+			else if (text == "!=" || text == "<>")
+				op = Op::ne;
+			else if (text == "<")
+				op = Op::lt;
+			else if (text == "<=")
+				op = Op::le;
+			else if (text == ">")
+				op = Op::gt;
+			else
+				op = Op::ge;
+		}
+		else if (IsKeyword("like"))
+			op = Op::like;
+		else if (IsKeyword("not")) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+			else if (!IsKeyword("like"))
+				return std::unexpected(ParseError::unexpected_token);
+
+			op = Op::not_like;
+		}
+		else
+			return AddNode(Op::truthy, *lhs);
+
+		if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		auto rhs = ParseOperand();
+		if (!rhs)
+			return rhs;
+
+		return AddNode(op, *lhs, *rhs);
+	}
+
+private:
+	bool StartsCondition() const
+	{
+		switch (token.type) {
+		case Token::Type::identifier:
+			return !IsKeyword("or");
+		case Token::Type::number:
+		case Token::Type::string:
+		case Token::Type::open:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	std::expected<void, ParseError> ReadString(char quote)
+	{
+		// quotes are escaped by doubling them. the game clients do not escape the quotes within user input
+		// (e.g. hostname like '%it's%') so a quote followed by a word only terminates the string if the word
+		// is a keyword or a column (e.g. mapname = 'x'gametype like '%cq%')
+		m_Pos++;
+		while (m_Pos < m_Input.size()) {
+			const auto c = m_Input[m_Pos++];
+			if (c != quote) {
+				token.value.push_back(c);
+				continue;
+			}
+
+			if (m_Pos < m_Input.size() && m_Input[m_Pos] == quote) {
+				token.value.push_back(quote);
+				m_Pos++;
+			}
+			else if (m_Pos == m_Input.size() || !std::isalnum(static_cast<unsigned char>(m_Input[m_Pos])) || StartsWord(m_Pos))
+				return {};
+			else
+				token.value.push_back(c);
+		}
+
+		return std::unexpected(ParseError::unterminated_string);
+	}
+
+	bool StartsWord(std::size_t pos) const
+	{
+		auto end = pos;
+		while (end < m_Input.size() && (std::isalnum(static_cast<unsigned char>(m_Input[end])) || m_Input[end] == '_'))
+			end++;
+
+		const auto word = m_Input.substr(pos, end - pos);
+		for (const auto& keyword : { "and", "or", "not", "like" }) {
+			if (::iequals(word, keyword))
+				return true;
+		}
+
+		return m_Resolve(word).has_value();
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseOperand()
+	{
+		auto operand = Operand{};
+		switch (token.type) {
+		case Token::Type::identifier:
+			if (IsKeyword("and") || IsKeyword("or") || IsKeyword("not") || IsKeyword("like"))
+				return std::unexpected(ParseError::unexpected_token);
+
+			operand.column = m_Resolve(token.text);
+			if (!operand.column)
+				return std::unexpected(ParseError::unknown_column);
+			break;
+		case Token::Type::number:
+			operand.text = token.text;
+			operand.number = ::to_number(token.text);
+			break;
+		case Token::Type::string:
+			operand.text = std::move(token.value);
+			break;
+		default:
+			return std::unexpected(ParseError::unexpected_token);
+		}
+
+		if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		m_Filter.m_Operands.push_back(std::move(operand));
+		return static_cast<std::uint32_t>(m_Filter.m_Operands.size() - 1);
+	}
+
+	std::uint32_t AddNode(Op op, std::uint32_t lhs, std::uint32_t rhs = 0)
+	{
+		m_Filter.m_Nodes.push_back(Node{ .op = op, .lhs = lhs, .rhs = rhs });
+		return static_cast<std::uint32_t>(m_Filter.m_Nodes.size() - 1);
+	}
+};
+
+std::expected<ServerFilter, ServerFilter::ParseError> ServerFilter::Parse(const std::string_view& filter, const ColumnResolver& resolve)
+{
+	auto result = ServerFilter{};
+	auto parser = Parser{ filter, resolve, result };
+	if (auto next = parser.Next(); !next)
+		return std::unexpected(next.error());
+	else if (parser.token.type == Token::Type::end)
+		return result;
+
+	// the nodes are added bottom up, so the root is the last one
+	auto root = parser.ParseOr();
+	if (!root)
+		return std::unexpected(root.error());
+	else if (parser.token.type != Token::Type::end)
+		return std::unexpected(ParseError::unexpected_token);
+
+	for (const auto& operand : result.m_Operands) {
+		if (operand.column && std::ranges::find(result.m_Columns, operand.column->index) == result.m_Columns.end())
+			result.m_Columns.push_back(operand.column->index);
+	}
+
+	result.CollectConstraints(*root);
+	return result;
+}
+
+void ServerFilter::CollectConstraints(std::uint32_t index)
+{
+	using Type = Constraint::Type;
+	const auto& node = m_Nodes[index];
+	auto type = Type{};
+	switch (node.op) {
+	case Op::op_and:
+		CollectConstraints(node.lhs);
+		CollectConstraints(node.rhs);
+		return;
+	case Op::eq: type = Type::eq; break;
+	case Op::lt: type = Type::lt; break;
+	case Op::le: type = Type::le; break;
+	case Op::gt: type = Type::gt; break;
+	case Op::ge: type = Type::ge; break;
+	default:
+		return;
+	}
+
+	const auto* column = &m_Operands[node.lhs];
+	const auto* literal = &m_Operands[node.rhs];
+	if (!column->column) {
+		// literal <op> column => column <reversed op> literal
+		std::swap(column, literal);
+		switch (type) {
+		case Type::lt: type = Type::gt; break;
+		case Type::le: type = Type::ge; break;
+		case Type::gt: type = Type::lt; break;
+		case Type::ge: type = Type::le; break;
+		default: break;
+		}
+	}
+
+	if (!column->column || literal->column)
+		return;
+
+	m_Constraints.push_back(Constraint{
+		.column = *column->column,
+		.type = type,
+		.text = literal->text,
+		.number = literal->number ? literal->number : ::to_number(literal->text)
+	});
+}
+
+bool ServerFilter::Matches(const Row& row) const
+{
+	return m_Nodes.empty() || Evaluate(static_cast<std::uint32_t>(m_Nodes.size() - 1), row);
+}
+
+namespace {
+	// sqlite-like conversion: empty numeric columns are 0, non-numeric text is not a number
+	template<typename Operand, typename Row>
+	std::string_view text_of(const Operand& operand, const Row& row)
+	{
+		if (!operand.column)
+			return operand.text;
+
+		return row[operand.column->index];
+	}
+
+	template<typename Operand, typename Row>
+	std::optional<double> number_of(const Operand& operand, const Row& row)
+	{
+		if (!operand.column)
+			return operand.number ? operand.number : ::to_number(operand.text);
+
+		const auto& text = ::text_of(operand, row);
+		if (text.empty() && operand.column->numeric)
+			return 0.0;
+
+		return ::to_number(text);
+	}
+}
+
+bool ServerFilter::Evaluate(std::uint32_t index, const Row& row) const
+{
+	const auto& node = m_Nodes[index];
+	switch (node.op) {
+	case Op::op_and:
+		return Evaluate(node.lhs, row) && Evaluate(node.rhs, row);
+	case Op::op_or:
+		return Evaluate(node.lhs, row) || Evaluate(node.rhs, row);
+	case Op::op_not:
+		return !Evaluate(node.lhs, row);
+	case Op::truthy:
+	{
+		const auto& value = ::number_of(m_Operands[node.lhs], row);
+		return value && *value != 0;
+	}
+	case Op::like:
+	case Op::not_like:
+		return ::like(::text_of(m_Operands[node.lhs], row), ::text_of(m_Operands[node.rhs], row)) == (node.op == Op::like);
+	default:
+		break;
+	}
+
+	const auto order = Compare(m_Operands[node.lhs], m_Operands[node.rhs], row);
+	switch (node.op) {
+	case Op::eq: return order == 0;
+	case Op::ne: return order != 0;
+	case Op::lt: return order < 0;
+	case Op::le: return order <= 0;
+	case Op::gt: return order > 0;
+	case Op::ge: return order >= 0;
+	default: return false;
+	}
+}
+
+std::partial_ordering ServerFilter::Compare(const Operand& lhs, const Operand& rhs, const Row& row) const
+{
+	// like sqlite: numeric columns convert the other side to a number (if possible), numbers are ordered before text
+	const auto numeric = (lhs.column && lhs.column->numeric) || (rhs.column && rhs.column->numeric) || (lhs.number && rhs.number);
+	if (numeric) {
+		const auto& a = ::number_of(lhs, row);
+		const auto& b = ::number_of(rhs, row);
+		if (a && b)
+			return *a <=> *b;
+		else if (a)
+			return std::partial_ordering::less;
+		else if (b)
+			return std::partial_ordering::greater;
+	}
+
+	return ::text_of(lhs, row) <=> ::text_of(rhs, row);
+}
\ No newline at end of file
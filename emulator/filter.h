@@ -0,0 +1,104 @@
+#pragma once
+#ifndef _GAMESPY_FILTER_H_
+#define _GAMESPY_FILTER_H_
+
+#include "string_pool.h"
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// compiled server list filter (the sql-like condition sent by the server browsers), e.g.
+	// numplayers > 0 and (gametype like '%ctf%' or not password)
+	// supported are comparisons (=, ==, !=, <>, <, <=, >, >=), [not] like, and, or, not and parentheses.
+	// the column names are resolved when parsing, so evaluating a filter only indexes into the server row
+	class ServerFilter
+	{
+	public:
+		struct Column
+		{
+			std::size_t index; // position of the value within the server row
+			bool numeric;      // the values are compared as numbers (integer and real columns)
+		};
+
+		using ColumnResolver = std::function<std::optional<Column>(const std::string_view& name)>;
+
+		// a comparison of a column with a literal that every matching server satisfies (i.e. it is and-ed with the rest of the filter)
+		struct Constraint
+		{
+			enum class Type : std::uint8_t { eq, lt, le, gt, ge };
+
+			Column column;
+			Type type;
+			std::string text;
+			std::optional<double> number; // the literal as number (if it is one)
+		};
+
+		enum class ParseError {
+			unexpected_token,
+			unterminated_string,
+			unknown_column,
+			too_complex
+		};
+
+		// an empty filter matches every server
+		static std::expected<ServerFilter, ParseError> Parse(const std::string_view& filter, const ColumnResolver& resolve);
+
+		// the (interned) values of a server by column, columns which are not part of the row (e.g. added after the server) are empty
+		struct Row
+		{
+			std::span<const StringPool::Id> values;
+			const StringPool& strings;
+
+			std::string_view operator[](std::size_t column) const noexcept { return column < values.size() ? strings[values[column]] : std::string_view{}; }
+		};
+
+		bool Matches(const Row& row) const;
+
+		auto columns() const -> const std::vector<std::size_t>& { return m_Columns; } // indices of the referenced columns
+		auto constraints() const -> const std::vector<Constraint>& { return m_Constraints; }
+
+	private:
+		struct Operand
+		{
+			std::optional<Column> column; // literal otherwise
+			std::string text;
+			std::optional<double> number; // set for numeric literals
+		};
+
+		enum class Op : std::uint8_t {
+			op_and, op_or, op_not,
+			eq, ne, lt, le, gt, ge,
+			like, not_like,
+			truthy
+		};
+
+		// and/or/not reference nodes, all other operations reference operands
+		struct Node
+		{
+			Op op;
+			std::uint32_t lhs = 0;
+			std::uint32_t rhs = 0;
+		};
+
+		std::vector<Node> m_Nodes; // the last node is the root
+		std::vector<Operand> m_Operands;
+		std::vector<std::size_t> m_Columns;
+		std::vector<Constraint> m_Constraints;
+
+		class Parser; // see filter.cpp
+
+		void CollectConstraints(std::uint32_t node);
+		bool Evaluate(std::uint32_t node, const Row& row) const;
+		std::partial_ordering Compare(const Operand& lhs, const Operand& rhs, const Row& row) const;
+	};
+}
+
+#endif
\ No newline at end of file
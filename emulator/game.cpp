@@ -1,12 +1,35 @@
 #include "game.h"
+#include "endpoint_table.h"
+#include "server_store.h"
+#include <algorithm>
 #include <print>
 #include <iostream>
+#include <map>
+#include <optional>
 using namespace gamespy;
 
 namespace {
 	constexpr auto gamespy_num_master_servers = 20;
 	constexpr auto gamespy_max_registered_keys = 254;
 	constexpr auto gamespy_max_popular_values = 255;
+	constexpr std::size_t max_cached_filters = 256;
+
+	std::optional<PlayerRoster::ServerKey> roster_key(const std::string_view& ip, std::uint16_t port)
+	{
+		// servers added via the admin interface are not required to have a valid address
+		auto error = boost::system::error_code{};
+		auto address = boost::asio::ip::make_address_v4(ip, error);
+		if (error)
+			return std::nullopt;
+
+		return endpoint_key(address, port);
+	}
+
+	std::string_view value_at(const StringPool& strings, const std::vector<StringPool::Id>& values, std::size_t column)
+	{
+		// keys added after the server was stored have no value yet
+		return column < values.size() ? strings[values[column]] : std::string_view{};
+	}
 }
 
 std::vector<GameData::GameKey> GameData::common_keys()
@@ -27,7 +50,7 @@ std::vector<GameData::GameKey> GameData::common_keys()
 }
 
 Game::Game(GameData data)
-	: m_DB{ data.name, false }, m_Data{ std::move(data) }
+	: m_Data{ std::move(data) }
 {
 	if (std::size(m_Data.keys) > ::gamespy_max_registered_keys)
 		throw std::overflow_error{ "too many keys" };
@@ -40,51 +63,34 @@ Game::~Game()
 
 task<void> Game::Connect()
 {
-	// note: no sql injection prevention for config (static or via ini-file) based initalization
-	std::string sql = R"SQL(
-		CREATE TABLE server(
-			__last_update DATETIME DEFAULT (unixepoch()),
-			__public_ip TEXT NOT NULL,
-			__public_port INTEGER NOT NULL
-	)SQL";
-
 	for (const auto& key : m_Data.keys) {
 		if (!IsValidParamName(key.name))
 			throw std::runtime_error{ std::format("parameter name {} is not allowed", key.name) };
 
 		m_Params.emplace(key.name, &key);
-		using StoreType = decltype(key.store);
-		switch (key.store) {
-		case StoreType::as_text:
-			sql += std::format(",{} TEXT", key.name);
-			break;
-		case StoreType::as_real:
-			sql += std::format(",{} REAL DEFAULT 0.00", key.name);
-			break;
-		case StoreType::as_integer:
-			sql += std::format(",{} INTEGER DEFAULT 0", key.name);
-			break;
-		default:
-			throw std::runtime_error{ std::format("parameter {} of invalid type {}", key.name, static_cast<int>(key.send)) };
-		}
 	}
 
-	sql += R"SQL(
-			,PRIMARY KEY(__public_ip, __public_port)
-		);
-		CREATE TRIGGER server_last_updated AFTER UPDATE ON server FOR EACH ROW
-		BEGIN
-			UPDATE server SET __last_update=(unixepoch()) WHERE rowid=NEW.rowid;
-		END;
-	)SQL";
-
-	m_DB.exec(sql);
+	m_Store = ServerStore::Create(m_Data, m_Strings);
 	std::println("[{}] registered - {}", name(), GetMasterServer());
-	co_return;
+
+	if (m_Data.popularValuesInterval.count()) {
+		const auto& executor = co_await boost::asio::this_coro::executor;
+		m_PopularValuesTimer.emplace(executor);
+		boost::asio::co_spawn(executor, RefreshPopularValues(), boost::asio::detached);
+	}
+
+	m_WriteTimer.emplace(co_await boost::asio::this_coro::executor);
 }
 
 task<void> Game::Disconnect()
 {
+	if (m_PopularValuesTimer)
+		m_PopularValuesTimer->cancel();
+
+	// the later writes are applied immediately
+	Flush();
+	m_WriteTimer.reset();
+
 	co_return;
 }
 
@@ -147,168 +153,591 @@ task<void> Game::AddOrUpdateServer(IncomingServer& server)
 	if (server.public_ip.empty() || server.public_port == 0)
 		throw std::runtime_error{ "server missing public_ip and/or public_port" };
 
-	// add missing keys (as columns) to the database (if auto keys is active)
-	auto insertSQL = std::string{ "INSERT OR REPLACE INTO server (__public_ip, __public_port" };
+	// add missing keys (as columns) to the store (if auto keys is active)
 	std::vector<std::string_view> columnsToAdd;
-	std::vector<std::string_view> valuesToInsert;
 	for (const auto& [key, value] : server.data) {
-		auto insertKeyValue = false;
 		if (m_Params.contains(key))
-			insertKeyValue = true;
-		else if (m_Data.misssingKeyPolicy == GameData::MissingKeyPolicy::add_as_string) {
-			if (!IsValidParamName(key))
-				throw std::runtime_error{ std::format("illegal column name: {}", key) };
-
-			columnsToAdd.push_back(key);
-		}
-		else
+			continue;
+		else if (m_Data.misssingKeyPolicy != GameData::MissingKeyPolicy::add_as_string) {
 			std::println("[{}] ignoring unknown key: {}", m_Data.name, key);
-
-		if (insertKeyValue) {
-			insertSQL += std::format(",{}", key);
-			valuesToInsert.push_back(value);
+			continue;
 		}
-	}
 
-	insertSQL += ") VALUES(?,?"; // first two values: public ip + port 
-	for (std::size_t i = 0, len = valuesToInsert.size(); i < len; i++)
-		insertSQL += ",?";
-	insertSQL += ')';
+		if (!IsValidParamName(key))
+			throw std::runtime_error{ std::format("illegal column name: {}", key) };
+
+		columnsToAdd.push_back(key);
+	}
 
 	if (!columnsToAdd.empty()) {
-		auto columnSQL = std::string{};
 		for (const auto& column : columnsToAdd) {
 			std::println("[gamedb][{}] new column: {}", m_Data.name, column);
-			if (m_Data.misssingKeyPolicy == GameData::MissingKeyPolicy::add_as_string)
-				columnSQL += std::format("ALTER TABLE server ADD COLUMN {} TEXT DEFAULT '';", column);
-			else
-				throw std::runtime_error{ std::format("unknown policy for adding new columns: {}", std::to_underlying(m_Data.misssingKeyPolicy)) };
+			m_Store->AddColumn(m_Data.keys.emplace_back(std::string(column)));
 		}
 
-		auto guard = m_DB.set_scoped_authorizer([&](auto action, auto detail1, auto detail2, auto dbName, auto trigger) {
-			using auth_action = sqlite::auth_action;
-			using auth_res = sqlite::auth_res;
-			if (action == auth_action::SQLITE_ALTER_TABLE && (detail1 == "temp" || detail1 == "main") && detail2 == "server")
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_FUNCTION
-				&& (detail2 == "printf" || detail2 == "substr" || detail2 == "length"))
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_READ
-				&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
-				&& (detail2 == "sql" || detail2 == "temp" || detail2 == "name" || detail2 == "type")
-				&& (dbName == "temp" || dbName == "main"))
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_UPDATE
-				&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
-				&& detail2 == "sql"
-				&& (dbName == "temp" || dbName == "main"))
-				return auth_res::SQLITE_OK;
-
-			std::println(std::cerr, "[{}][columns] unauthorized: action({}) detail1({}), detail2({}), db({}), trigger({})", name(), std::to_underlying(action), detail1, detail2, dbName, trigger);
-			// this will make the stmt throw an error
-			return sqlite::auth_res::SQLITE_DENY;
-		});
+		// adding keys might have moved the existing ones
+		m_Params.clear();
+		for (const auto& key : m_Data.keys)
+			m_Params.emplace(key.name, &key);
+	}
 
-		m_DB.exec(columnSQL);
+	auto values = std::vector<StringPool::Id>(m_Data.keys.size(), StringPool::EMPTY);
+	for (const auto& [key, value] : server.data) {
+		if (auto param = m_Params.find(key); param != m_Params.end())
+			values[GetKeyIndex(*param->second)] = m_Strings.Intern(value);
+	}
 
-		for (const auto& column : columnsToAdd) {
-			const auto& key = m_Data.keys.emplace_back(std::string(column));
-			m_Params.emplace(key.name, &key);
+	auto& write = GetPendingWrite(server.public_ip, server.public_port);
+	ReleaseValues(write);
+	write.removed = false;
+	write.last_update = Clock::now();
+	write.values = std::move(values);
+	ScheduleFlush();
+
+	// required to make this a coroutine
+	co_return;
+}
+
+task<std::optional<Game::ServerCursor>> Game::OpenServers(const std::string_view& query, const std::vector<std::string_view>& fields)
+{
+	const auto& filter = GetFilter(query);
+	if (!filter)
+		co_return std::nullopt;
+
+	auto columns = std::vector<std::size_t>{};
+	for (const auto& field : fields) {
+		auto param = m_Params.find(field);
+		if (param == m_Params.end()) {
+			std::println(std::cerr, "[{}] failed to query servers (query={}): unknown field {}", name(), query, field);
+			co_return std::nullopt;
 		}
+
+		columns.push_back(GetKeyIndex(*param->second));
 	}
 
-	auto stmt = sqlite::stmt{ m_DB, insertSQL };
-	stmt.bind_at(1, server.public_ip);
-	stmt.bind_at(2, server.public_port);
+	for (const auto& column : filter->columns()) {
+		if (++m_ColumnUsage[column] >= INDEX_THRESHOLD && !m_Indexes.contains(column) && m_Indexes.size() < MAX_INDEXES)
+			BuildIndex(column);
+	}
 
-	for (decltype(valuesToInsert)::size_type i = 0, size = valuesToInsert.size(); i < size; i++)
-		stmt.bind_at(i + 3, valuesToInsert[i]);
+	auto cursor = ServerCursor{ *this, *filter, fields, std::move(columns) };
 
-	stmt.insert();
+	// the smallest candidate set of the indexed constraints (the filter is still evaluated on all of them)
+	for (const auto& constraint : filter->constraints()) {
+		auto index = m_Indexes.find(constraint.column.index);
+		if (index == m_Indexes.end())
+			continue;
 
-	OnServerAdded(server);
+		auto found = index->second.Find(constraint);
+		if (found && (!cursor.m_Candidates || found->size() < cursor.m_Candidates->size()))
+			cursor.m_Candidates = std::move(found);
+	}
 
-	// required to make this a coroutine
-	co_return;
+	co_return cursor;
 }
 
 task<std::vector<Game::SavedServer>> Game::GetServers(const std::string_view& query, const std::vector<std::string_view>& fields, std::size_t limit, std::size_t skip)
 {
-	auto error = std::string{};
-
-	auto sql = std::string{ "SELECT __last_update,__public_ip,__public_port" };
-	for (const auto& field : fields)
-		sql += std::format(",{}", field);
-
-	// the scoped authorizer prevents SQL injection
-	auto guard = m_DB.set_scoped_authorizer([&](auto action, auto detail1, auto detail2, auto dbName, auto trigger) {
-		using auth_action = sqlite::auth_action;
-		using auth_res = sqlite::auth_res;
-		if (action == auth_action::SQLITE_READ && detail1 == "server" && (dbName == "temp" || dbName == "main"))
-			return auth_res::SQLITE_OK; // maybe we need to prevent queries on local{ip\d+|port} columns (=detail2)?
-		else if (action == auth_action::SQLITE_SELECT)
-			return auth_res::SQLITE_OK;
-		else if (action == auth_action::SQLITE_FUNCTION && (detail2 == "like"))
-			return auth_res::SQLITE_OK;
-
-		std::println(std::cerr, "[{}][retrieve] unauthorized: action({}) detail1({}), detail2({}), db({}), trigger({})", name(), std::to_underlying(action), detail1, detail2, dbName, trigger);
-		return auth_res::SQLITE_DENY;
-	});
+	auto servers = std::vector<Game::SavedServer>{};
+	auto cursor = co_await OpenServers(query, fields);
+	if (!cursor)
+		co_return servers;
+
+	auto server = Game::SavedServer{};
+	while (servers.size() < limit && cursor->Next(server)) {
+		if (skip)
+			skip--;
+		else
+			servers.push_back(server);
+	}
 
-	sql += " FROM server";
-	if (!query.empty())
-		sql += std::format(" WHERE {}", query);
+	co_return servers;
+}
 
-	sql += std::format(" LIMIT {}", limit);
+task<std::optional<Game::SavedServer>> Game::GetServer(const std::string_view& ip, std::uint16_t port)
+{
+	const auto& stored = m_Servers.find(std::format("{}:{}", ip, port));
+	if (stored == m_Servers.end())
+		co_return std::nullopt;
+
+	auto server = SavedServer{
+		.last_update = stored->second.last_update,
+		.public_ip = stored->second.public_ip,
+		.public_port = stored->second.public_port,
+		.version = stored->second.version
+	};
 
-	if (skip)
-		sql += std::format(" OFFSET {}", skip);
+	// key\0value\0... (the format of the full rules of the sdk's qr2 queries)
+	auto appendRule = [&server](const std::string_view& key, const std::string_view& value) {
+		server.rules.append(key);
+		server.rules.push_back('\0');
+		server.rules.append(value);
+		server.rules.push_back('\0');
+	};
 
-	auto servers = std::vector<Game::SavedServer>{};
+	for (std::size_t column = 0, size = m_Data.keys.size(); column < size; column++) {
+		const auto& value = ::value_at(m_Strings, stored->second.values, column);
+		if (value.empty())
+			continue;
 
-	try {
-		auto stmt = sqlite::stmt{ m_DB, sql };
-		while (stmt.query()) {
-			auto lastUpdated = stmt.column_at<std::time_t>(0);
-			auto server = Game::SavedServer{
-				.last_update = Clock::from_time_t(lastUpdated),
-				.public_ip = stmt.column_at<std::string>(1),
-				.public_port = stmt.column_at<std::uint16_t>(2)
-			};
-
-			for (std::size_t i = 0, size = fields.size(); i < size; i++)
-				server.data.emplace(fields[i], stmt.column_at<std::string>(i + 3));
+		server.data.emplace(m_Data.keys[column].name, value);
+		appendRule(m_Data.keys[column].name, value);
+	}
 
-			servers.push_back(server);
+	// the team table of the heartbeats is not retained
+	if (auto key = ::roster_key(ip, port)) {
+		const auto& players = m_Roster.GetPlayers(*key);
+		for (std::size_t i = 0, size = players.size(); i < size; i++) {
+			appendRule(std::format("player_{}", i), players[i].name);
+			appendRule(std::format("score_{}", i), std::to_string(players[i].score));
+			appendRule(std::format("ping_{}", i), std::to_string(players[i].ping));
+			appendRule(std::format("team_{}", i), std::to_string(players[i].team));
 		}
 	}
-	catch (const std::exception& e) {
-		std::println(std::cerr, "[{}] failed to query servers (query={}): {}", name(), query, e.what());
+
+	co_return server;
+}
+
+Game::ServerCursor::ServerCursor(Game& game, ServerFilter filter, const std::vector<std::string_view>& fields, std::vector<std::size_t> columns)
+	: m_Game{ &game }, m_Filter{ std::move(filter) }, m_Fields{ fields }, m_Columns{ std::move(columns) }, m_Next{ game.m_Servers.begin() }, m_Generation{ game.m_Generation }
+{
+
+}
+
+bool Game::ServerCursor::Next(SavedServer& server)
+{
+	auto& servers = m_Game->m_Servers;
+	while (true) {
+		auto iter = servers.cend();
+		if (m_Game->m_Generation != m_Generation) {
+			// the servers were modified: the candidates and the iterator might be invalid,
+			// the remaining servers are scanned (the candidates are ordered like the servers)
+			m_Candidates.reset();
+			m_Next = m_Started ? servers.upper_bound(m_LastKey) : servers.begin();
+			m_Generation = m_Game->m_Generation;
+		}
+
+		if (m_Candidates) {
+			if (m_NextCandidate >= m_Candidates->size())
+				return false;
+
+			iter = servers.find((*m_Candidates)[m_NextCandidate++]);
+			if (iter == servers.end())
+				continue;
+		}
+		else {
+			if (m_Next == servers.end())
+				return false;
+
+			iter = m_Next++;
+		}
+
+		m_LastKey = iter->first;
+		m_Started = true;
+
+		const auto& stored = iter->second;
+		if (!m_Filter.Matches({ stored.values, m_Game->m_Strings }))
+			continue;
+
+		// assigned in place, so that the buffers of the previous server are reused
+		server.last_update = stored.last_update;
+		server.public_ip.assign(stored.public_ip);
+		server.public_port = stored.public_port;
+		server.version = stored.version;
+		for (std::size_t i = 0, size = m_Fields.size(); i < size; i++)
+			server.data[m_Fields[i]].assign(::value_at(m_Game->m_Strings, stored.values, m_Columns[i]));
+
+		if (m_Complete)
+			m_Complete(server);
+
+		return true;
 	}
+}
 
-	co_return servers;
+void Game::ServerCursor::SkipPast(const SavedServer& server)
+{
+	m_LastKey = std::format("{}:{}", server.public_ip, server.public_port);
+	m_Started = true;
+	if (m_Candidates)
+		m_NextCandidate = std::ranges::upper_bound(*m_Candidates, std::string_view{ m_LastKey }) - m_Candidates->begin();
+	else
+		m_Next = m_Game->m_Servers.upper_bound(m_LastKey);
+}
+
+const ServerFilter* Game::GetFilter(const std::string_view& query)
+{
+	if (auto filter = m_Filters.find(query); filter != m_Filters.end())
+		return &filter->second;
+
+	auto filter = ServerFilter::Parse(query, [this](const std::string_view& column) -> std::optional<ServerFilter::Column> {
+		auto param = m_Params.find(column);
+		if (param == m_Params.end())
+			return std::nullopt;
+
+		return ServerFilter::Column{
+			.index = GetKeyIndex(*param->second),
+			.numeric = param->second->store != KeyType::Store::as_text
+		};
+	});
+
+	if (!filter) {
+		std::println(std::cerr, "[{}] invalid server filter (query={}): {}", name(), query, std::to_underlying(filter.error()));
+		return nullptr;
+	}
+
+	// the filters are mostly generated by the game clients, so only a few distinct ones are expected
+	if (m_Filters.size() >= ::max_cached_filters)
+		m_Filters.clear();
+
+	return &m_Filters.emplace(query, std::move(*filter)).first->second;
+}
+
+void Game::BuildIndex(std::size_t column)
+{
+	const auto& key = m_Data.keys[column];
+	std::println("[{}] indexing column {}", name(), key.name);
+
+	auto& index = m_Indexes.try_emplace(column, key.store != KeyType::Store::as_text).first->second;
+	for (const auto& [serverKey, stored] : m_Servers)
+		index.Add(serverKey, ::value_at(m_Strings, stored.values, column));
+}
+
+std::vector<Game::ColumnStats> Game::GetColumnStats() const
+{
+	auto stats = std::vector<ColumnStats>{};
+	for (const auto& [column, queries] : m_ColumnUsage) {
+		const auto& index = m_Indexes.find(column);
+		const auto indexed = index != m_Indexes.end();
+		stats.push_back(ColumnStats{
+			.name = m_Data.keys[column].name,
+			.queries = queries,
+			.indexed = indexed,
+			.values = indexed ? index->second.values() : 0,
+			.hits = indexed ? index->second.hits() : 0
+		});
+	}
+
+	return stats;
 }
 
 task<void> Game::RemoveServers(const std::vector<std::pair<std::string_view, std::uint16_t>>& servers)
 {
-	auto stmt = sqlite::stmt{ m_DB, "DELETE FROM server WHERE __public_ip=? and __public_port=?" };
 	for (const auto& [ip, port] : servers) {
-		stmt.bind(ip, port);
-		stmt.update();
-		stmt.reset();
-
-		OnServerRemoved(ip, port);
+		auto& write = GetPendingWrite(ip, port);
+		ReleaseValues(write);
+		write.removed = true;
+		write.values.reset();
+		write.players.reset();
 	}
 
+	ScheduleFlush();
 	co_return;
 }
 
+auto Game::GetPendingWrite(const std::string_view& ip, std::uint16_t port) -> PendingWrite&
+{
+	auto key = std::format("{}:{}", ip, port);
+	if (auto pending = m_PendingIndex.find(key); pending != m_PendingIndex.end())
+		return m_PendingWrites[pending->second];
+
+	m_PendingIndex.emplace(std::move(key), m_PendingWrites.size());
+	return m_PendingWrites.emplace_back(PendingWrite{
+		.last_update = Clock::now(),
+		.public_ip = std::string{ ip },
+		.public_port = port
+	});
+}
+
+void Game::ReleaseValues(PendingWrite& write)
+{
+	if (!write.values)
+		return;
+
+	for (const auto& value : *write.values)
+		m_Strings.Release(value);
+
+	write.values.reset();
+}
+
+void Game::ScheduleFlush()
+{
+	if (!m_WriteTimer) {
+		Flush();
+		return;
+	}
+
+	// even full batches are applied by the timer, so that the writer is resumed before its write is applied
+	// (and receives OnServerWriteFailed afterwards). the window starts with the first write of a batch
+	const auto full = m_PendingWrites.size() >= std::max<std::size_t>(m_Data.writeBatchSize, 1);
+	if (full && m_FlushState != FlushState::full) {
+		m_FlushState = FlushState::full;
+		m_WriteTimer->expires_at(boost::asio::steady_timer::time_point::min());
+	}
+	else if (!full && m_FlushState == FlushState::idle) {
+		m_FlushState = FlushState::window;
+		m_WriteTimer->expires_after(m_Data.writeBatchWindow);
+	}
+	else
+		return;
+
+	// also applied if the wait is cancelled (replaced by a full batch or by Disconnect)
+	m_WriteTimer->async_wait([this](const boost::system::error_code&) {
+		// not called by a request handler, so nothing else would catch the errors
+		try {
+			Flush();
+		}
+		catch (const std::exception& e) {
+			std::println(std::cerr, "[{}] failed to apply the pending writes: {}", name(), e.what());
+		}
+	});
+}
+
+void Game::Flush()
+{
+	if (m_PendingWrites.empty())
+		return;
+
+	m_FlushState = FlushState::idle;
+	if (m_WriteTimer)
+		m_WriteTimer->cancel();
+
+	auto writes = std::exchange(m_PendingWrites, {});
+	m_PendingIndex.clear();
+
+	// the store is written first (the failed writes are skipped), the servers are then modified without suspending
+	auto failed = std::vector<bool>(writes.size(), false);
+	try {
+		m_Store->BeginBatch();
+		for (std::size_t i = 0, size = writes.size(); i < size; i++) {
+			const auto& write = writes[i];
+			if (!write.removed && !write.values)
+				continue;
+
+			// not yet modified, so the store receives the values it is replacing
+			const auto stored = m_Servers.find(std::format("{}:{}", write.public_ip, write.public_port));
+			const auto previous = stored != m_Servers.end() ? std::span<const StringPool::Id>{ stored->second.values } : std::span<const StringPool::Id>{};
+			try {
+				if (write.removed)
+					m_Store->Remove(write.public_ip, write.public_port, previous);
+				else
+					m_Store->Upsert(write.public_ip, write.public_port, previous, *write.values);
+			}
+			catch (const std::exception& e) {
+				std::println(std::cerr, "[{}] failed to store server {}:{}: {}", name(), write.public_ip, write.public_port, e.what());
+				failed[i] = true;
+			}
+		}
+
+		m_Store->EndBatch();
+	}
+	catch (const std::exception& e) {
+		// the store might be behind the servers until they are written again
+		std::println(std::cerr, "[{}] failed to store {} servers: {}", name(), writes.size(), e.what());
+	}
+
+	auto changed = false;
+	auto added = std::vector<const StoredServer*>(writes.size(), nullptr);
+	for (std::size_t i = 0, size = writes.size(); i < size; i++) {
+		auto& write = writes[i];
+		const auto& key = std::format("{}:{}", write.public_ip, write.public_port);
+		const auto& rosterKey = ::roster_key(write.public_ip, write.public_port);
+		if (failed[i])
+			ReleaseValues(write); // the players are still applied to the previous values
+		else if (write.removed) {
+			if (auto stored = m_Servers.find(key); stored != m_Servers.end()) {
+				for (auto& [column, index] : m_Indexes)
+					index.Remove(stored->first, ::value_at(m_Strings, stored->second.values, column));
+
+				for (const auto& value : stored->second.values)
+					m_Strings.Release(value);
+
+				m_Servers.erase(stored);
+			}
+
+			if (rosterKey)
+				m_Roster.Remove(*rosterKey);
+
+			changed = true;
+			continue;
+		}
+		else if (write.values) {
+			auto [iter, inserted] = m_Servers.try_emplace(key);
+			const auto& storedKey = iter->first;
+			auto& stored = iter->second;
+			if (!inserted) {
+				for (auto& [column, index] : m_Indexes)
+					index.Remove(storedKey, ::value_at(m_Strings, stored.values, column));
+			}
+
+			stored.last_update = write.last_update;
+			stored.public_ip = write.public_ip;
+			stored.public_port = write.public_port;
+			for (const auto& value : stored.values)
+				m_Strings.Release(value);
+
+			stored.values = std::move(*write.values);
+			stored.version = m_Generation + 1; // the generation is incremented once the batch is applied
+
+			for (auto& [column, index] : m_Indexes)
+				index.Add(storedKey, ::value_at(m_Strings, stored.values, column));
+
+			added[i] = &stored;
+			changed = true;
+		}
+
+		// the players of unregistered (e.g. removed) servers are dropped
+		if (write.players && rosterKey && m_Servers.contains(key)) {
+			const auto& players = *write.players;
+			m_Roster.Update(*rosterKey, players.map, QRHeartbeatPacket::Table{
+				.header = { players.header.begin(), players.header.end() },
+				.cells = { players.cells.begin(), players.cells.end() }
+			});
+		}
+	}
+
+	if (changed)
+		m_Generation++;
+
+	for (std::size_t i = 0, size = writes.size(); i < size; i++) {
+		const auto& write = writes[i];
+		if (failed[i]) {
+			try {
+				OnServerWriteFailed(write.public_ip, write.public_port);
+			}
+			catch (const std::exception& e) {
+				std::println(std::cerr, "[{}] failed to notify the failed write of server {}:{}: {}", name(), write.public_ip, write.public_port, e.what());
+			}
+
+			continue;
+		}
+		else if (write.removed) {
+			try {
+				OnServerRemoved(write.public_ip, write.public_port);
+			}
+			catch (const std::exception& e) {
+				std::println(std::cerr, "[{}] failed to notify the removal of server {}:{}: {}", name(), write.public_ip, write.public_port, e.what());
+			}
+
+			continue;
+		}
+		else if (!added[i])
+			continue; // players only
+
+		const auto& stored = *added[i];
+		auto server = IncomingServer{
+			.last_update = stored.last_update,
+			.public_ip = stored.public_ip,
+			.public_port = stored.public_port
+		};
+
+		for (std::size_t column = 0, columns = m_Data.keys.size(); column < columns; column++) {
+			const auto& value = ::value_at(m_Strings, stored.values, column);
+			if (!value.empty())
+				server.data.emplace(m_Data.keys[column].name, value);
+		}
+
+		// the listeners of the other servers are still notified
+		try {
+			OnServerAdded(server);
+		}
+		catch (const std::exception& e) {
+			std::println(std::cerr, "[{}] failed to notify the update of server {}:{}: {}", name(), write.public_ip, write.public_port, e.what());
+		}
+	}
+}
+
+task<void> Game::UpdatePlayers(const std::string_view& ip, std::uint16_t port, const std::string_view& map, const QRHeartbeatPacket::Table& players)
+{
+	// servers added via the admin interface are not required to have a valid address (and have no players)
+	if (!::roster_key(ip, port))
+		co_return;
+
+	// applied with the values of the same batch (the players are only known for registered servers)
+	auto& write = GetPendingWrite(ip, port);
+	write.players = PendingPlayers{
+		.map = std::string{ map },
+		.header = { players.header.begin(), players.header.end() },
+		.cells = { players.cells.begin(), players.cells.end() }
+	};
+
+	ScheduleFlush();
+}
+
 void Game::CheckPopularValueSize(std::size_t newSize)
 {
 	if (newSize > gamespy_max_popular_values)
 		throw std::overflow_error{ "too many popular values" };
 }
 
+std::optional<std::uint8_t> Game::GetPopularValueIndex(const std::string_view& value) const
+{
+	if (auto index = m_PopularValueIndex.find(value); index != m_PopularValueIndex.end())
+		return index->second;
+
+	return std::nullopt;
+}
+
+void Game::SetPopularValues(decltype(m_PopularValues) values)
+{
+	CheckPopularValueSize(std::size(values));
+	if (values == m_PopularValues)
+		return;
+
+	m_PopularValues = std::move(values);
+	m_PopularValueIndex.clear();
+	for (std::size_t i = 0, size = m_PopularValues.size(); i < size; i++)
+		m_PopularValueIndex.try_emplace(m_PopularValues[i], static_cast<std::uint8_t>(i));
+
+	m_PopularValuesVersion++;
+}
+
+task<void> Game::RefreshPopularValues()
+{
+	auto& timer = *m_PopularValuesTimer;
+	while (true) {
+		timer.expires_after(m_Data.popularValuesInterval);
+		auto [error] = co_await timer.async_wait(boost::asio::as_tuple(boost::asio::use_awaitable));
+		if (error)
+			break;
+
+		try {
+			UpdatePopularValues();
+		}
+		catch (const std::exception& e) {
+			std::println(std::cerr, "[{}] failed to update the popular values: {}", name(), e.what());
+		}
+	}
+}
+
+void Game::UpdatePopularValues()
+{
+	// a popular value is sent as a single byte instead of 0xFF, the value and its null terminator.
+	// only values shared by multiple servers are considered, ranked by the bytes they save per server list
+	auto savings = std::map<StringPool::Id, std::size_t>{}; // the values are interned, so equal values of different keys have the same id
+	for (const auto& key : m_Data.keys) {
+		if (key.send != KeyType::Send::as_string || key.store != KeyType::Store::as_text)
+			continue;
+
+		for (const auto& [value, count] : m_Store->GetSharedValues(GetKeyIndex(key)))
+			savings[value] += count * (m_Strings[value].size() + 1);
+	}
+
+	auto ranked = std::vector<std::pair<std::size_t, std::string_view>>{};
+	for (const auto& [value, saved] : savings)
+		ranked.emplace_back(saved, m_Strings[value]);
+
+	// ties are broken by the value, so that the same data always results in the same list
+	std::ranges::sort(ranked, std::greater<>{});
+	if (ranked.size() > ::gamespy_max_popular_values)
+		ranked.resize(::gamespy_max_popular_values);
+
+	auto values = decltype(m_PopularValues){};
+	for (const auto& [saved, value] : ranked)
+		values.emplace_back(value);
+
+	SetPopularValues(std::move(values));
+}
+
 namespace {
 	// verify the gamespy invariants at the bottom of the file so it doesn't pollute the rest of the file
 #ifdef _HASHTABLE_H
@@ -3,12 +3,20 @@
 #define _GAMESPY_GAMEDATA_H_
 
 #include "asio.h"
+#include "filter.h"
 #include "task.h"
 #include "utils.h"
-#include "sqlite.h"
+#include "roster.h"
+#include "server_index.h"
+#include "string_pool.h"
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 #include <boost/signals2.hpp>
 
@@ -60,19 +68,85 @@ namespace gamespy {
 			add_as_string
 		} misssingKeyPolicy = MissingKeyPolicy::ignore;
 
+		// servers which neither sent a heartbeat nor a keepalive within this duration are removed
+		std::chrono::seconds serverTimeout{ 60 };
+
+		// the popular values are recomputed from the registered servers in this interval (0 = disabled)
+		std::chrono::seconds popularValuesInterval{ 30 };
+
+		// the written servers are applied in batches: once the first write of a batch is older than this window
+		// or once the batch contains writeBatchSize servers (a window of 0 applies every write once its writer completed)
+		std::chrono::milliseconds writeBatchWindow{ 20 };
+		std::size_t writeBatchSize = 512;
+
+		// the table of the registered servers (see ServerStore)
+		enum class Storage : std::uint8_t {
+			native,
+			sqlite
+		} storage = Storage::native;
+
 		static std::vector<GameKey> common_keys();
 	};
 
+	class ServerStore;
 	class Game
 	{
-		sqlite::db m_DB; // stores added servers (in-memory)
+		StringPool m_Strings; // the values of the servers (shared with the store)
+		std::unique_ptr<ServerStore> m_Store; // created when connecting
 		GameData m_Data;
 		std::map<std::string_view, const GameData::GameKey*> m_Params; // references to m_Data.keys
 
+		// the registered servers, the server list queries are evaluated on these (and not the store)
+		struct StoredServer
+		{
+			Clock::time_point last_update;
+			std::string public_ip;
+			std::uint16_t public_port;
+			std::vector<StringPool::Id> values; // by key index (see m_Data.keys)
+			std::uint64_t version = 0; // the generation in which the values were stored
+		};
+		std::map<std::string, StoredServer, std::less<>> m_Servers; // ip:port
+		std::map<std::string, ServerFilter, std::less<>> m_Filters; // compiled server list filters
+
+		// columns used by the filters of at least INDEX_THRESHOLD queries are indexed (up to MAX_INDEXES)
+		static constexpr std::size_t INDEX_THRESHOLD = 32;
+		static constexpr std::size_t MAX_INDEXES = 8;
+		std::map<std::size_t, std::size_t> m_ColumnUsage; // key index => filtered queries
+		std::map<std::size_t, ServerIndex> m_Indexes; // key index => index
+		std::uint64_t m_Generation = 0; // incremented whenever a server is added, updated or removed
+
 		// the (up to) 254 most frequently used values of the key-value pairs of the sever data can be
 		// stored here. instead of then sending the actual value, only the index within this array is sent.
 		// the popular values are sent initially when the server list is queried
 		std::vector<std::string> m_PopularValues;
+		std::unordered_map<std::string, std::uint8_t, utils::string_hash, std::equal_to<>> m_PopularValueIndex; // value => position in m_PopularValues
+		std::uint64_t m_PopularValuesVersion = 0; // incremented whenever the popular values change
+		std::optional<boost::asio::steady_timer> m_PopularValuesTimer;
+
+		PlayerRoster m_Roster; // players of the registered servers (updated by the heartbeats)
+
+		// the writes of a batch (values, removals and players) share a store transaction, the readers see either none or all of them
+		// and the listeners are notified once the whole batch was applied (in the order of the writes)
+		struct PendingPlayers
+		{
+			std::string map;
+			std::vector<std::string> header;
+			std::vector<std::string> cells; // row-major (see QRHeartbeatPacket::Table)
+		};
+
+		struct PendingWrite
+		{
+			Clock::time_point last_update;
+			std::string public_ip;
+			std::uint16_t public_port;
+			bool removed = false;
+			std::optional<std::vector<StringPool::Id>> values; // nullopt if unchanged
+			std::optional<PendingPlayers> players; // nullopt if unchanged, only applied to registered servers
+		};
+		std::vector<PendingWrite> m_PendingWrites;
+		std::map<std::string, std::size_t, std::less<>> m_PendingIndex; // ip:port => position in m_PendingWrites (only the last write of a server is applied)
+		std::optional<boost::asio::steady_timer> m_WriteTimer;
+		enum class FlushState : std::uint8_t { idle, window, full } m_FlushState = FlushState::idle;
 
 	public:
 		using KeyType = GameData::GameKey;
@@ -90,33 +164,89 @@ namespace gamespy {
 			// this can be used e.g. for highscore tracking
 			// (haven't really figured it out completely, but bf2 doesn't use it anyways)
 			StringType rules;
+
+			// saved servers only: changes whenever the server is stored again (see ServerRecordCache)
+			std::uint64_t version = 0;
 		};
 
 		using IncomingServer = ServerData<std::string_view>;
 		using SavedServer = ServerData<std::string>;
 
+		// lazily evaluated server query, the servers are written into a caller provided (reusable) SavedServer.
+		// the game may be modified while a cursor is open (e.g. while its owner is suspended), the cursor then
+		// continues after the last returned server. the fields are referenced, not copied
+		class ServerCursor
+		{
+			friend class Game;
+
+			Game* m_Game;
+			ServerFilter m_Filter;
+			std::vector<std::string_view> m_Fields;
+			std::vector<std::size_t> m_Columns; // key index of each field
+			std::optional<std::vector<std::string_view>> m_Candidates; // narrowed by an index
+			std::size_t m_NextCandidate = 0;
+			decltype(m_Servers)::const_iterator m_Next;
+			std::uint64_t m_Generation;
+			std::string m_LastKey;
+			bool m_Started = false;
+			std::function<void(SavedServer&)> m_Complete;
+
+			ServerCursor(Game& game, ServerFilter filter, const std::vector<std::string_view>& fields, std::vector<std::size_t> columns);
+
+		public:
+			bool Next(SavedServer& server);
+
+			// continues after the given server (e.g. the last one of a previous query with the same filter)
+			void SkipPast(const SavedServer& server);
+
+			// called for every returned server, e.g. to add values which are not part of the heartbeats (bf2_ranked)
+			void OnServer(std::function<void(SavedServer&)> complete) { m_Complete = std::move(complete); }
+		};
+
+		struct ColumnStats
+		{
+			std::string_view name;
+			std::size_t queries; // number of filtered queries using the column
+			bool indexed;
+			std::size_t values;  // distinct values (indexed columns only)
+			std::size_t hits;    // queries answered by the index
+		};
+
 		Game(GameData data);
 		virtual ~Game();
 
 		virtual task<void> Connect();
 		virtual task<void> Disconnect();
 
+		virtual task<void> Refresh() { co_return; } // reloads the data a game keeps from external sources (e.g. the bf2 stats providers)
+
 		virtual task<void> AddOrUpdateServer(IncomingServer& server);
-		virtual task<std::vector<SavedServer>> GetServers(const std::string_view& query, const std::vector<std::string_view>& fields, std::size_t limit, std::size_t skip = 0);
+		virtual task<std::optional<ServerCursor>> OpenServers(const std::string_view& query, const std::vector<std::string_view>& fields); // nullopt if the query is invalid
+		task<std::vector<SavedServer>> GetServers(const std::string_view& query, const std::vector<std::string_view>& fields, std::size_t limit, std::size_t skip = 0);
+		virtual task<std::optional<SavedServer>> GetServer(const std::string_view& ip, std::uint16_t port); // all keys, the rules contain the keys and players
 		virtual task<void> RemoveServers(const std::vector<std::pair<std::string_view, std::uint16_t>>& servers);
+		task<void> UpdatePlayers(const std::string_view& ip, std::uint16_t port, const std::string_view& map, const QRHeartbeatPacket::Table& players);
+		void Flush(); // applies the pending writes (see GameData::writeBatchWindow)
 
 		boost::signals2::signal<void(const IncomingServer&)> OnServerAdded;
 		boost::signals2::signal<void(const std::string_view&, std::uint16_t)> OnServerRemoved;
+		boost::signals2::signal<void(const std::string_view&, std::uint16_t)> OnServerWriteFailed; // the server keeps its previous values until it is written again
 
 		std::string GetMasterServer() const; // calculates the designated master server (%s.ms%d.gamespy.com) for this game
 		auto& GetPopularValues() const { return m_PopularValues; }
-		void SetPopularValues(decltype(m_PopularValues) values) { CheckPopularValueSize(std::size(values)); m_PopularValues.assign_range(values); }
+		auto GetPopularValuesVersion() const { return m_PopularValuesVersion; }
+		std::optional<std::uint8_t> GetPopularValueIndex(const std::string_view& value) const;
+		void SetPopularValues(decltype(m_PopularValues) values);
 
 		auto name() const -> std::string_view { return m_Data.name; }
 		auto secretKey() const { return m_Data.secretKey; }
 		auto queryPort() const { return m_Data.queryPort; }
 		auto availability() const { return m_Data.availability; }
 		auto backend() const { return m_Data.backend; }
+		auto serverTimeout() const { return m_Data.serverTimeout; }
+		auto roster() const -> const PlayerRoster& { return m_Roster; }
+		auto generation() const { return m_Generation; }
+		std::vector<ColumnStats> GetColumnStats() const;
 		auto keys() const -> const decltype(m_Data.keys)& { return m_Data.keys; }
 
 		static bool IsValidParamName(const std::string_view& paramName);
@@ -125,6 +255,14 @@ namespace gamespy {
 
 	private:
 		void CheckPopularValueSize(std::size_t size);
+		std::size_t GetKeyIndex(const KeyType& key) const { return static_cast<std::size_t>(&key - m_Data.keys.data()); }
+		const ServerFilter* GetFilter(const std::string_view& query);
+		void BuildIndex(std::size_t column);
+		PendingWrite& GetPendingWrite(const std::string_view& ip, std::uint16_t port);
+		void ReleaseValues(PendingWrite& write);
+		void ScheduleFlush();
+		task<void> RefreshPopularValues();
+		void UpdatePopularValues();
 	};
 }
 
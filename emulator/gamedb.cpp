@@ -1,6 +1,8 @@
 #include "gamedb.h"
 #include "game.h"
 #include "bf2.h"
+#include <iostream>
+#include <print>
 using namespace gamespy;
 
 GameDB::GameDB()
@@ -13,14 +15,14 @@ GameDB::~GameDB()
 
 }
 
-GameDBInMemory::GameDBInMemory(boost::asio::io_context& context)
-	: GameDB{ }, m_Context{ context }
+GameDBInMemory::GameDBInMemory(boost::asio::io_context& context, GameData::Storage storage)
+	: GameDB{ }, m_Context{ context }, m_Storage{ storage }
 {
 
 }
 
-GameDBInMemory::GameDBInMemory(boost::asio::io_context& context, nlohmann::json config)
-	: GameDB{ }, m_Context{ context }, m_Config(std::move(config))
+GameDBInMemory::GameDBInMemory(boost::asio::io_context& context, GameData::Storage storage, nlohmann::json config)
+	: GameDB{ }, m_Context{ context }, m_Config(std::move(config)), m_Storage{ storage }
 {
 	if (!ValidateConfig(m_Config)) {
 		throw std::runtime_error{ "invalid config" };
@@ -63,7 +65,7 @@ task<void> GameDBInMemory::Connect()
 	};
 
 	if (m_Config.empty()) {
-		auto bf2 = std::make_shared<BF2>(m_Context);
+		auto bf2 = std::make_shared<BF2>(m_Context, m_Storage);
 		co_await bf2->Connect();
 		m_Games.emplace("battlefield2", bf2);
 	}
@@ -78,7 +80,7 @@ task<void> GameDBInMemory::Connect()
 				params.password = entry.at("mysql-password").get<std::string>();
 				params.database = entry.at("mysql-database").get<std::string>();
 
-				game = std::make_shared<BF2>(m_Context, params);
+				game = std::make_shared<BF2>(m_Context, params, m_Storage);
 			}
 			else {
 				game = std::make_shared<Game>(GameData{
@@ -91,7 +93,12 @@ task<void> GameDBInMemory::Connect()
 						entry.at("saveAsReal"),
 						entry.at("ignoredKeys")
 					),
-					.misssingKeyPolicy = entry.at("autoKeys").get<bool>() ? GameData::MissingKeyPolicy::add_as_string : GameData::MissingKeyPolicy::ignore
+					.misssingKeyPolicy = entry.at("autoKeys").get<bool>() ? GameData::MissingKeyPolicy::add_as_string : GameData::MissingKeyPolicy::ignore,
+					.serverTimeout = std::chrono::seconds{ entry.value("serverTimeout", 60) },
+					.popularValuesInterval = std::chrono::seconds{ entry.value("popularValuesInterval", 30) },
+					.writeBatchWindow = std::chrono::milliseconds{ entry.value("writeBatchWindow", 20) },
+					.writeBatchSize = entry.value<std::size_t>("writeBatchSize", 512),
+					.storage = m_Storage
 				});
 			}
 
@@ -104,7 +111,8 @@ task<void> GameDBInMemory::Connect()
 		auto gmtest = std::make_shared<Game>(GameData{
 			.name = "gmtest",
 			.secretKey = "HA6zkS",
-			.keys = GameData::common_keys()
+			.keys = GameData::common_keys(),
+			.storage = m_Storage
 		});
 		co_await gmtest->Connect();
 		m_Games.emplace("gmtest", gmtest);
@@ -140,5 +148,21 @@ task<std::vector<std::shared_ptr<Game>>> GameDBInMemory::GetGames()
 
 bool GameDBInMemory::ValidateConfig(const nlohmann::json& config)
 {
+	for (const auto& entry : config) {
+		// a server with a timeout of 0 would be removed right after it was added
+		if (entry.value("serverTimeout", 60) <= 0) {
+			std::println(std::cerr, "[gamedb] {}: serverTimeout must be positive", entry.value("name", ""));
+			return false;
+		}
+
+		// negative intervals would make the timers fire immediately again (0 disables the popular values)
+		for (const auto& key : { "popularValuesInterval", "writeBatchWindow" }) {
+			if (entry.value(key, 0) < 0) {
+				std::println(std::cerr, "[gamedb] {}: {} must not be negative", entry.value("name", ""), key);
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
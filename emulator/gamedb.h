@@ -3,6 +3,7 @@
 #define _GAMESPY_GAME_DB_H_
 
 #include "asio.h"
+#include "game.h"
 #include "task.h"
 #include <map>
 #include <memory>
@@ -31,10 +32,11 @@ namespace gamespy {
 		boost::asio::io_context& m_Context;
 		std::map<std::string_view, std::shared_ptr<Game>> m_Games;
 		nlohmann::json m_Config;
+		GameData::Storage m_Storage; // of all games
 
 	public:
-		GameDBInMemory(boost::asio::io_context& context);
-		GameDBInMemory(boost::asio::io_context& context, nlohmann::json config);
+		GameDBInMemory(boost::asio::io_context& context, GameData::Storage storage);
+		GameDBInMemory(boost::asio::io_context& context, GameData::Storage storage, nlohmann::json config);
 		~GameDBInMemory();
 
 		virtual task<void> Connect() override;
@@ -1,11 +1,12 @@
 #include "gpcm.h"
+#include "admission.h"
 #include "gpcm.client.h"
 #include <print>
 #include <utility>
 using namespace gamespy;
 
-LoginServer::LoginServer(boost::asio::io_context& context, GameDB& gameDB, PlayerDB& playerDB)
-	: m_Acceptor{ context, boost::asio::ip::tcp::endpoint{ boost::asio::ip::tcp::v4(), PORT } }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }
+LoginServer::LoginServer(boost::asio::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB)
+	: m_Acceptor{ context, boost::asio::ip::tcp::endpoint{ boost::asio::ip::tcp::v4(), PORT } }, m_Admission{ admission }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }
 {
 	std::println("[login] starting up: {} TCP", PORT);
 	std::println("[login] (gpcm.gamespy.com)");
@@ -23,6 +24,10 @@ boost::asio::awaitable<void> LoginServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		boost::asio::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), boost::asio::detached);
 	}
 }
@@ -1,11 +1,12 @@
 #include "gpsp.h"
+#include "admission.h"
 #include "gpsp.client.h"
 #include <print>
 #include <utility>
 using namespace gamespy;
 
-SearchServer::SearchServer(boost::asio::io_context& context, PlayerDB& db)
-	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)), m_DB(db)
+SearchServer::SearchServer(boost::asio::io_context& context, Admission& admission, PlayerDB& db)
+	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)), m_Admission(admission), m_DB(db)
 {
 	std::println("[search] starting up: {} TCP", PORT);
 	std::println("[search] (gpsp.gamespy.com)");
@@ -23,6 +24,10 @@ boost::asio::awaitable<void> SearchServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		boost::asio::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), boost::asio::detached);
 	}
 }
@@ -1,12 +1,13 @@
 #include "http.h"
+#include "admission.h"
 #include "http.client.h"
 #include <print>
 #include "gamedb.h"
 
 using namespace gamespy;
 
-HttpServer::HttpServer(boost::asio::io_context& context, GameDB& gameDB, PlayerDB& playerDB)
-	: m_Acceptor{ context, boost::asio::ip::tcp::endpoint{ boost::asio::ip::tcp::v4(), 80 } }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }
+HttpServer::HttpServer(boost::asio::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB)
+	: m_Acceptor{ context, boost::asio::ip::tcp::endpoint{ boost::asio::ip::tcp::v4(), 80 } }, m_Admission{ admission }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }
 {
 	std::println("[http] starting up (battlefield 2 unlocker)");
 }
@@ -23,6 +24,10 @@ boost::asio::awaitable<void> HttpServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		boost::asio::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), boost::asio::detached);
 	}
 }
@@ -4,16 +4,18 @@
 #include "asio.h"
 
 namespace gamespy {
+	class Admission;
 	class GameDB;
 	class PlayerDB;
 	
 	class HttpServer {
 		boost::asio::ip::tcp::acceptor m_Acceptor;
+		Admission& m_Admission;
 		GameDB& m_GameDB;
 		PlayerDB& m_PlayerDB;
 
 	public:
-		HttpServer(boost::asio::io_context& context, GameDB& gameDB, PlayerDB& playerDB);
+		HttpServer(boost::asio::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB);
 		~HttpServer();
 
 		boost::asio::awaitable<void> AcceptClients();
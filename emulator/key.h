@@ -2,20 +2,28 @@
 #ifndef _GAMESPY_KEY_H_
 #define _GAMESPY_KEY_H_
 #include "asio.h"
+#include "admission.h"
+#include "datagram.h"
 namespace gamespy {
 	class CDKeyServer
 	{
 		static constexpr std::uint16_t PORT = 29910;
 
 		boost::asio::ip::udp::socket m_Socket;
+		DatagramBatch m_Datagrams;
+		Admission m_Admission;
 
 	public:
-		CDKeyServer(boost::asio::io_context& context);
+		CDKeyServer(boost::asio::io_context& context, const Admission::Config& admission);
 		~CDKeyServer();
 
 		boost::asio::awaitable<void> AcceptConnections();
 
+		auto& replyStats() const noexcept { return m_Datagrams.stats(); }
+		auto& admissionStats() const noexcept { return m_Admission.stats(); }
+
 	private:
+		boost::asio::awaitable<void> ReceiveRequests();
 		boost::asio::awaitable<void> HandleKeyRequest();
 	};
 }
@@ -2,19 +2,125 @@
 #include "gamedb.h"
 #include "utils.h"
 #include "qr.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
 #include <numeric>
 #include <print>
 #include <span>
+#include <stdexcept>
 #include <string_view>
 #include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 using namespace gamespy;
 using boost::asio::ip::udp;
 
-MasterServer::MasterServer(boost::asio::io_context& context, GameDB& db)
-	: m_Socket{ context, udp::endpoint{ udp::v4(), PORT } }, m_CleanupTimer{ context }, m_DB { db }
+namespace {
+	udp::socket make_socket(boost::asio::io_context& context, std::uint16_t port, bool shared)
+	{
+		auto socket = udp::socket{ context, udp::v4() };
+		if (shared) {
+#ifdef SO_REUSEPORT
+			using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+			socket.set_option(reuse_port{ true });
+#else
+			throw std::runtime_error{ "sharing the master server port requires SO_REUSEPORT" };
+#endif
+		}
+
+		socket.bind(udp::endpoint{ udp::v4(), port });
+		return socket;
+	}
+
+	std::uint64_t fingerprint(std::span<const QRHeartbeatPacket::KeyValue> data)
+	{
+		// the data is sorted by key, so the same data always results in the same fingerprint
+		auto hash = utils::fnv1a_basis;
+		for (const auto& [key, value] : data) {
+			hash = utils::fnv1a(key, hash);
+			hash = utils::fnv1a(std::string_view{ "\0", 1 }, hash);
+			hash = utils::fnv1a(value, hash);
+			hash = utils::fnv1a(std::string_view{ "\0", 1 }, hash);
+		}
+
+		return hash;
+	}
+
+	std::uint64_t fingerprint(const QRHeartbeatPacket::Table& table, const std::string_view& map)
+	{
+		auto hash = utils::fnv1a(map);
+		for (const auto& cells : { std::span{ table.header }, std::span{ table.cells } }) {
+			for (const auto& cell : cells) {
+				hash = utils::fnv1a(cell, hash);
+				hash = utils::fnv1a(std::string_view{ "\0", 1 }, hash);
+			}
+		}
+
+		return hash;
+	}
+
+	// snapshot file: the header followed by one record per validated server, in native byte order (the file is only read by the same host)
+	// record: endpoint key (8), last update in milliseconds since the unix epoch (8), instance (4), game name length (2), heartbeat length (4), game name, heartbeat
+	constexpr std::array<char, 8> snapshot_magic{ 'G', 'S', 'Q', 'R', 'S', 'N', 'P', '1' };
+
+	template<typename T>
+	void write_value(std::ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	// bounds checked reader of the mapped snapshot
+	class SnapshotReader
+	{
+		std::span<const std::uint8_t> m_Data;
+		bool m_Valid = true;
+
+	public:
+		explicit SnapshotReader(std::span<const std::uint8_t> data) : m_Data{ data } {}
+
+		explicit operator bool() const noexcept { return m_Valid; }
+
+		template<typename T>
+		T read()
+		{
+			auto value = T{};
+			const auto& bytes = read(sizeof(T));
+			if (!bytes.empty())
+				std::memcpy(&value, bytes.data(), sizeof(T));
+
+			return value;
+		}
+
+		std::span<const std::uint8_t> read(std::size_t size)
+		{
+			if (!m_Valid || size > m_Data.size()) {
+				m_Valid = false;
+				return {};
+			}
+
+			const auto& bytes = m_Data.first(size);
+			m_Data = m_Data.subspan(size);
+			return bytes;
+		}
+	};
+
+	// forwards the call to the executor the games are running on and resumes on the caller's executor afterwards
+	template<typename T>
+	task<T> run_on(const boost::asio::any_io_executor& executor, task<T> work)
+	{
+		co_return co_await boost::asio::co_spawn(executor, std::move(work), boost::asio::use_awaitable);
+	}
+}
+
+MasterServer::MasterServer(boost::asio::io_context& context, const Admission::Config& admission, GameDB& db, boost::asio::any_io_executor gameExecutor, bool shared, MasterSnapshot* snapshot)
+	: m_Socket{ ::make_socket(context, PORT, shared) }, m_Datagrams{ m_Socket }, m_Admission{ admission }, m_DB{ db }, m_GameExecutor{ std::move(gameExecutor) }, m_Epoch{ ExpiryClock::now() }, m_CleanupTimer{ context },
+	m_Snapshot{ snapshot }
 {
-	std::println("[master] starting up: {} UDP", PORT);
+	std::println("[master] starting up: {} UDP{}", PORT, shared ? " (shared)" : "");
 	std::println("[master] (%s.available.gamespy.com)");
 	std::println("[master] (master.gamepsy.com)");
 	std::println("[master] (%s.master.gamepsy.com)");
@@ -25,31 +131,147 @@ MasterServer::~MasterServer()
 	std::println("[master] shutting down");
 }
 
+boost::asio::awaitable<std::optional<std::uint16_t>> MasterServer::GetGameId(const std::string_view& gamename)
+{
+	// there are only a handful of games, so a linear search is faster than any map
+	for (std::size_t i = 0, size = m_Games.size(); i < size; i++) {
+		if (m_Games[i]->name() == gamename)
+			co_return static_cast<std::uint16_t>(i);
+	}
+
+	if (!co_await m_DB.HasGame(gamename))
+		co_return std::nullopt;
+
+	auto game = co_await m_DB.GetGame(gamename);
+
+	// the game might have been interned while waiting for the database
+	for (std::size_t i = 0, size = m_Games.size(); i < size; i++) {
+		if (m_Games[i] == game)
+			co_return static_cast<std::uint16_t>(i);
+	}
+
+	if (m_Games.size() > std::numeric_limits<std::uint16_t>::max())
+		throw std::overflow_error{ "too many games" };
+
+	// the games apply the heartbeats in batches (after AddOrUpdateServer returned), so a failed write is reported
+	// by the game. the fingerprint is then cleared, so that the next heartbeat is stored again
+	m_GameConnections.emplace_back(game->OnServerWriteFailed.connect([this](const std::string_view& ip, std::uint16_t port) {
+		auto error = boost::system::error_code{};
+		const auto address = boost::asio::ip::make_address_v4(ip, error);
+		if (error)
+			return;
+
+		// called on the game executor
+		boost::asio::post(m_Socket.get_executor(), [this, key = endpoint_key(address, port)]() {
+			if (auto entry = m_Servers.find(key); entry && entry->validated)
+				entry->fingerprint = 0;
+		});
+	}));
+
+	m_Games.push_back(std::move(game));
+	co_return static_cast<std::uint16_t>(m_Games.size() - 1);
+}
+
+std::uint32_t MasterServer::StorePayload(std::span<const std::uint8_t> payload)
+{
+	if (m_FreePayloads.empty()) {
+		m_Payloads.emplace_back(payload.begin(), payload.end());
+		return static_cast<std::uint32_t>(m_Payloads.size() - 1);
+	}
+
+	auto index = m_FreePayloads.back();
+	m_FreePayloads.pop_back();
+	m_Payloads[index].assign(payload.begin(), payload.end());
+	return index;
+}
+
+void MasterServer::StorePayload(server& server, std::span<const std::uint8_t> payload)
+{
+	if (server.payload == server::no_payload)
+		server.payload = StorePayload(payload);
+	else
+		m_Payloads[server.payload].assign(payload.begin(), payload.end());
+}
+
+void MasterServer::ReleasePayload(std::uint32_t payload)
+{
+	if (payload == server::no_payload)
+		return;
+
+	// the buffer is kept (cleared) so that the next pending server can reuse its capacity
+	m_Payloads[payload].clear();
+	m_FreePayloads.push_back(payload);
+}
+
+MasterServer::ExpiryWheel::Tick MasterServer::GetTick(ExpiryClock::time_point time) const
+{
+	return static_cast<ExpiryWheel::Tick>(std::chrono::floor<std::chrono::seconds>(time - m_Epoch).count());
+}
+
+MasterServer::ExpiryWheel::Tick MasterServer::GetDeadline(const server& server) const
+{
+	// rounded up, the wheel must not fire before the timeout actually elapsed
+	const auto& timeout = m_Games[server.game]->serverTimeout();
+	return static_cast<ExpiryWheel::Tick>(std::chrono::ceil<std::chrono::seconds>(server.last_update + timeout - m_Epoch).count());
+}
+
 boost::asio::awaitable<void> MasterServer::Cleanup()
 {
+	auto expired = std::map<std::uint16_t, std::vector<udp::endpoint>>{};
 	while (true) {
-		m_CleanupTimer.expires_after(std::chrono::seconds{ 60 });
+		m_CleanupTimer.expires_at(m_Epoch + std::chrono::seconds{ m_Expiry.now() + 1 });
 		const auto& [error] = co_await m_CleanupTimer.async_wait(boost::asio::as_tuple);
 		if (error) break;
 
-		const auto& now = Clock::now();
-		for (auto& servers : std::array{ &m_AwaitingValidation, &m_Validated }) {
-			for (auto i = servers->begin(); i != servers->end(); ) {
-				auto timeSinceLastUpdate = std::chrono::duration_cast<std::chrono::seconds>(now - i->second.last_update);
-				if (timeSinceLastUpdate > std::chrono::seconds{ 60 }) {
-					std::println("[master][server][{}] {}:{} timed out", i->second.gamename, i->first.address().to_string(), i->first.port());
-					auto game = co_await m_DB.GetGame(i->second.gamename);
-					// not pusing into a outer vector because the remove servers expects a string_view which would be dangling after this iteration
-					auto addr = i->first.address().to_string();
-					co_await game->RemoveServers({ std::make_pair(addr, i->first.port()) });
-					i = servers->erase(i);
-				}
-				else
-					++i;
+		m_Expiry.Advance(GetTick(ExpiryClock::now()), [&](EndpointKey key, ExpiryWheel::Tick deadline) {
+			auto entry = m_Servers.find(key);
+			if (!entry || entry->expires != deadline)
+				return;
+
+			// the server was refreshed since the record was scheduled
+			if (const auto actual = GetDeadline(*entry); actual > m_Expiry.now()) {
+				entry->expires = actual;
+				m_Expiry.Schedule(key, actual);
+				return;
 			}
+
+			const auto endpoint = endpoint_from_key(key);
+			std::println("[master][server][{}] {}:{} timed out", m_Games[entry->game]->name(), endpoint.address().to_string(), endpoint.port());
+			if (entry->validated)
+				expired[entry->game].push_back(endpoint);
+
+			ReleasePayload(entry->payload);
+			m_Servers.erase(key);
+		});
+
+		// one removal per game (and not per server)
+		for (auto& [gameId, endpoints] : expired) {
+			if (endpoints.empty())
+				continue;
+
+			auto addrs = std::vector<std::string>{};
+			auto servers = std::vector<std::pair<std::string_view, std::uint16_t>>{};
+			addrs.reserve(endpoints.size());
+			servers.reserve(endpoints.size());
+			for (const auto& endpoint : endpoints) {
+				addrs.push_back(endpoint.address().to_string());
+				servers.emplace_back(addrs.back(), endpoint.port());
+			}
+
+			const auto game = m_Games[gameId];
+			co_await ::run_on(m_GameExecutor, game->RemoveServers(servers));
+			endpoints.clear();
 		}
 	}
-	
+}
+
+boost::asio::awaitable<void> MasterServer::RemoveExpired(const std::shared_ptr<Game>& game, const udp::endpoint& endpoint)
+{
+	// the server timed out while it was being added (or updated): the removal of Cleanup might have been queued before the update
+	auto addr = endpoint.address().to_string();
+	std::println("[master][server][{}] {}:{} timed out while being updated", game->name(), addr, endpoint.port());
+	auto servers = std::vector<std::pair<std::string_view, std::uint16_t>>{ { addr, endpoint.port() } };
+	co_await ::run_on(m_GameExecutor, game->RemoveServers(servers));
 }
 
 boost::asio::awaitable<void> MasterServer::HandleAvailable(const udp::endpoint& client, QRPacket& packet)
@@ -65,13 +287,13 @@ boost::asio::awaitable<void> MasterServer::HandleAvailable(const udp::endpoint&
 		using Availability = decltype(available);
 		switch (available) {
 		case Availability::available:
-			co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\0"), client, boost::asio::use_awaitable);
+			m_Datagrams.Send(client, "\xFE\xFD\x09\0\0\0\0");
 			break;
 		case Availability::disabled_temporary:
-			co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\1"), client, boost::asio::use_awaitable);
+			m_Datagrams.Send(client, "\xFE\xFD\x09\0\0\0\1");
 			break;
 		case Availability::disabled_permanently:
-			co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\2"), client, boost::asio::use_awaitable);
+			m_Datagrams.Send(client, "\xFE\xFD\x09\0\0\0\2");
 			break;
 		}
 	}
@@ -79,8 +301,9 @@ boost::asio::awaitable<void> MasterServer::HandleAvailable(const udp::endpoint&
 
 boost::asio::awaitable<void> MasterServer::HandleHeartbeat(const udp::endpoint& client, QRPacket& _packet)
 {
-	const auto packet = QRHeartbeatPacket::Parse(_packet);
-	if (!packet) {
+	// m_Heartbeat is shared by the handlers, which is fine because they are awaited one after another
+	auto& heartbeat = m_Heartbeat;
+	if (!heartbeat.Parse(_packet)) {
 		std::println("[master] received invalid HEARTBEAT packet");
 		co_return;
 	}
@@ -93,29 +316,77 @@ boost::asio::awaitable<void> MasterServer::HandleHeartbeat(const udp::endpoint&
 	//
 	// sample packet:
 	// 0x03 (4-byte instance key)(n-bytes gameserver values: gamename 0x00 battlefield2 0x00 gamever 0x00 1.5....0x00) 0x00
-	if (!packet->serverData.contains("gamename")) {
+	const auto gamename = heartbeat.find("gamename");
+	if (!gamename) {
 		std::println("[master] received HEARTBEAT with empty gamename");
 		co_return;
 	}
 
-	const auto& gamename = packet->serverData.at("gamename");
-	if (!co_await m_DB.HasGame(gamename)) {
-		std::println("[master] received HEARTBEAT for unknown game {}", gamename);
+	const auto gameId = co_await GetGameId(*gamename);
+	if (!gameId) {
+		std::println("[master] received HEARTBEAT for unknown game {}", *gamename);
 		co_return;
 	}
 
-	auto game = co_await m_DB.GetGame(gamename);
-	if (m_Validated.contains(client)) {
+	// copy: the interned games might grow while this handler is suspended
+	const auto game = m_Games[*gameId];
+	const auto key = endpoint_key(client);
+	auto entry = m_Servers.find(key);
+	if (!entry && m_Snapshot)
+		entry = co_await ClaimRestored(key);
+
+	if (entry && entry->validated) {
+		entry->last_update = ExpiryClock::now();
+
+		// most servers send the same data until the map changes, unchanged heartbeats only refresh the timestamp
+		// statechanged (set by the server whenever its state changes) always forces an update
+		const auto hash = ::fingerprint(heartbeat.serverData());
+		const auto stateChanged = heartbeat.find("statechanged");
+		const auto dataChanged = hash != entry->fingerprint || (stateChanged && *stateChanged != "0");
+
+		// the players change more often (scores, pings) and are therefore tracked separately
+		const auto map = heartbeat.find("mapname").value_or("");
+		const auto rosterHash = ::fingerprint(heartbeat.players(), map);
+		const auto rosterChanged = rosterHash != entry->roster_fingerprint;
+		if (!dataChanged && !rosterChanged)
+			co_return;
+
+		if (m_Snapshot)
+			StorePayload(*entry, _packet.data);
+
 		auto addr = client.address().to_string();
-		auto server = Game::IncomingServer{
-			.last_update = Clock::now(),
-			.public_ip = addr,
-			.public_port = client.port(),
-			.data = packet->serverData
-		};
-		co_await game->AddOrUpdateServer(server);
+		if (dataChanged) {
+			// the parse does not allocate, but a changed heartbeat is still copied into the map of the game
+			auto server = Game::IncomingServer{
+				.last_update = Clock::now(),
+				.public_ip = addr,
+				.public_port = client.port(),
+				.data = { std::from_range, heartbeat.serverData() }
+			};
+			co_await ::run_on(m_GameExecutor, game->AddOrUpdateServer(server));
+
+			// remembered once queued (the table might have changed while awaiting the update), cleared again if the game fails to store it
+			entry = m_Servers.find(key);
+			if (!entry || !entry->validated) {
+				co_await RemoveExpired(game, client);
+				co_return;
+			}
+
+			entry->fingerprint = hash;
+		}
+
+		if (rosterChanged) {
+			co_await ::run_on(m_GameExecutor, game->UpdatePlayers(addr, client.port(), map, heartbeat.players()));
+			entry = m_Servers.find(key);
+			if (!entry || !entry->validated) {
+				co_await RemoveExpired(game, client);
+				co_return;
+			}
+
+			entry->roster_fingerprint = rosterHash;
+		}
 	}
-	else if (!m_AwaitingValidation.contains(client)) {
+	else if (!entry) {
 		// Note: The challenge needs to be even-sized so that the base64 encoding can be generated without padding
 		// This is required because the gamespy encoding is only base64-ish and handles the padding differently than regular base64 encoding
 		
@@ -126,28 +397,32 @@ boost::asio::awaitable<void> MasterServer::HandleHeartbeat(const udp::endpoint&
 		
 		auto challenge = utils::random_string("ABCDEFGHJIKLMNOPQRSTUVWXYZ123456789", 7);
 		auto responseData = std::format("{}{:2X}{:8X}{:4X}", challenge, std::to_underlying(game->backend()), client.address().to_v4().to_uint(), client.port());
+		auto proof = utils::encode(game->secretKey(), responseData);
+		if (proof.size() > std::tuple_size_v<decltype(server::proof)>)
+			throw std::length_error{ "challenge proof too long" };
 
 		std::vector<uint8_t> response;
 		response.push_back(0xFE);
 		response.push_back(0xFD);
 		response.push_back(0x01);
-		response.append_range(packet->instance);
+		response.append_range(_packet.instance);
 		response.append_range(responseData);
 		response.push_back(0);
 
-		m_AwaitingValidation.emplace(client, server{ 
-			.last_update = Clock::now(),
-			.proof = utils::encode(game->secretKey(), responseData),
-			.instance = packet->instance,
-			.gamename = std::string{ gamename },
-			.values = std::map<std::string, std::string>(packet->serverData.begin(), packet->serverData.end())
-		});
-		co_await m_Socket.async_send_to(boost::asio::buffer(response), client, boost::asio::use_awaitable);
+		auto [pending, inserted] = m_Servers.try_emplace(key);
+		pending->last_update = ExpiryClock::now();
+		pending->proof_length = static_cast<std::uint8_t>(std::ranges::copy(proof, pending->proof.begin()).out - pending->proof.begin());
+		pending->validated = false;
+		pending->game = *gameId;
+		pending->instance = _packet.instance;
+		pending->payload = StorePayload(_packet.data);
+		pending->expires = GetDeadline(*pending);
+		m_Expiry.Schedule(key, pending->expires);
+		m_Datagrams.Send(client, response);
 	}
-	else if (m_AwaitingValidation.contains(client)) {
-		auto& server = m_AwaitingValidation.at(client);
-		server.last_update = Clock::now();
-		server.values = std::map<std::string, std::string>(packet->serverData.begin(), packet->serverData.end());
+	else {
+		entry->last_update = ExpiryClock::now();
+		m_Payloads[entry->payload].assign(_packet.data.begin(), _packet.data.end());
 	}
 }
 
@@ -155,94 +430,432 @@ boost::asio::awaitable<void> MasterServer::HandleKeepAlive(const udp::endpoint&
 {
 	// example packet: 0x08 (4-byte-instance-id) 0x00
 
-	if (m_AwaitingValidation.contains(client))
-		m_AwaitingValidation[client].last_update = Clock::now();
-	else if (m_Validated.contains(client))
-		m_Validated[client].last_update = Clock::now();
+	const auto key = endpoint_key(client);
+	auto entry = m_Servers.find(key);
+	if (!entry && m_Snapshot)
+		entry = co_await ClaimRestored(key);
+
+	if (entry)
+		entry->last_update = ExpiryClock::now();
 	else
 		std::println("[master] received KEEPALIVE for unknown server {}:{}", client.address().to_string(), client.port());
-
-	co_return;
 }
 
 boost::asio::awaitable<void> MasterServer::HandleChallenge(const udp::endpoint& client, QRPacket& packet)
 {
-	auto iter = m_AwaitingValidation.find(client);
-	if (iter != m_AwaitingValidation.end()) {
-		const auto& challenge = std::string{ reinterpret_cast<const char*>(packet.data.data()) };
-		if (iter->second.proof == challenge) {
-			// Note: instance is currently ignored
-			m_Validated.emplace(client, iter->second);
+	const auto key = endpoint_key(client);
+	auto entry = m_Servers.find(key);
+	if (!entry || entry->validated) {
+		std::println("[master] received challenge for an unknown server");
+		co_return;
+	}
 
-			std::vector<std::uint8_t> response;
-			response.push_back(0xFE);
-			response.push_back(0xFD);
-			response.push_back(0x0A);
-			response.append_range(iter->second.instance);
+	auto challenge = std::string_view{ reinterpret_cast<const char*>(packet.data.data()), packet.data.size() };
+	challenge = challenge.substr(0, challenge.find('\0'));
+	if (std::string_view{ entry->proof.data(), entry->proof_length } != challenge) {
+		ReleasePayload(entry->payload);
+		m_Servers.erase(key);
+		co_return;
+	}
 
-			co_await m_Socket.async_send_to(boost::asio::buffer(response), client, boost::asio::use_awaitable);
+	// Note: instance is currently ignored
+	auto payload = std::exchange(entry->payload, server::no_payload);
+	const auto game = m_Games[entry->game];
+	entry->validated = true;
 
-			auto addr = client.address().to_string();
-			auto server = Game::IncomingServer{
-				.last_update = iter->second.last_update,
-				.public_ip = addr,
-				.public_port = client.port(),
-				.data = std::map<std::string_view, std::string_view>{ std::from_range, iter->second.values }
-			};
+	std::vector<std::uint8_t> response;
+	response.push_back(0xFE);
+	response.push_back(0xFD);
+	response.push_back(0x0A);
+	response.append_range(entry->instance);
 
-			auto game = co_await m_DB.GetGame(iter->second.gamename);
-			co_await game->AddOrUpdateServer(server);
-			std::println("[master][server][{}] {}:{} added", iter->second.gamename, server.public_ip, server.public_port);
-		}
+	m_Datagrams.Send(client, response);
+
+	// the stored heartbeat was already parsed successfully when it was received
+	auto& heartbeat = m_Heartbeat;
+	heartbeat.Parse(QRPacket{
+		.type = QRPacket::Type::heartbeat,
+		.instance = entry->instance,
+		.data = m_Payloads[payload]
+	});
 
-		m_AwaitingValidation.erase(iter);
+	auto addr = client.address().to_string();
+	auto server = Game::IncomingServer{
+		.last_update = Clock::now(),
+		.public_ip = addr,
+		.public_port = client.port(),
+		.data = { std::from_range, heartbeat.serverData() }
+	};
+
+	const auto hash = ::fingerprint(heartbeat.serverData());
+	const auto map = heartbeat.find("mapname").value_or("");
+	const auto rosterHash = ::fingerprint(heartbeat.players(), map);
+	co_await ::run_on(m_GameExecutor, game->AddOrUpdateServer(server));
+	co_await ::run_on(m_GameExecutor, game->UpdatePlayers(addr, client.port(), map, heartbeat.players()));
+	entry = m_Servers.find(key);
+	if (!entry || !entry->validated) {
+		ReleasePayload(payload);
+		co_await RemoveExpired(game, client);
+		co_return;
 	}
-	else
-		std::println("[master] received challenge for an unknown server");
+
+	entry->fingerprint = hash;
+	entry->roster_fingerprint = rosterHash;
+
+	// kept for the snapshot (unless a newer heartbeat was stored meanwhile)
+	if (m_Snapshot && entry->payload == server::no_payload)
+		entry->payload = std::exchange(payload, server::no_payload);
+
+	ReleasePayload(payload);
+
+	std::println("[master][server][{}] {}:{} added", game->name(), server.public_ip, server.public_port);
 }
 
 boost::asio::awaitable<void> MasterServer::Run()
 {
 	using namespace boost::asio::experimental::awaitable_operators;
-	co_await (AcceptConnections() && Cleanup());
+	co_await (AcceptConnections() && m_Datagrams.RunSender() && Cleanup());
+}
+
+boost::asio::awaitable<MasterServer::server*> MasterServer::ClaimRestored(EndpointKey key)
+{
+	auto restored = m_Snapshot->Claim(key);
+	if (!restored)
+		co_return nullptr;
+
+	// the server is already registered in its game (see MasterSnapshot::Load), so it is validated right away
+	const auto gameId = co_await GetGameId(restored->game->name());
+	if (!gameId)
+		co_return nullptr;
+
+	auto [entry, inserted] = m_Servers.try_emplace(key);
+	entry->last_update = ExpiryClock::now();
+	entry->validated = true;
+	entry->game = *gameId;
+	entry->instance = restored->instance;
+	entry->payload = StorePayload(restored->payload);
+	entry->fingerprint = restored->fingerprint;
+	entry->roster_fingerprint = restored->roster_fingerprint;
+	entry->expires = GetDeadline(*entry);
+	m_Expiry.Schedule(key, entry->expires);
+	co_return entry;
+}
+
+std::vector<std::pair<EndpointKey, MasterSnapshot::Server>> MasterServer::GetSnapshot()
+{
+	auto servers = std::vector<std::pair<EndpointKey, MasterSnapshot::Server>>{};
+	m_Servers.for_each([&](EndpointKey key, const server& server) {
+		if (!server.validated || server.payload == server::no_payload)
+			return;
+
+		servers.emplace_back(key, MasterSnapshot::Server{
+			.game = m_Games[server.game],
+			.last_update = server.last_update,
+			.instance = server.instance,
+			.payload = m_Payloads[server.payload]
+		});
+	});
+
+	return servers;
 }
 
 boost::asio::awaitable<void> MasterServer::AcceptConnections()
 {
-	std::array<std::uint8_t, 1400> buff;
 	while (m_Socket.is_open()) {
-		udp::endpoint client;
-		const auto& [error, length] = co_await m_Socket.async_receive_from(boost::asio::buffer(buff), client, boost::asio::as_tuple);
-		if (error || length == 0) break;
+		const auto& [error, datagrams] = co_await m_Datagrams.Receive();
+		if (error) break;
 
-		try {
-			auto packet = QRPacket::Parse(std::span{ buff.data(), length });
-			if (!packet) {
-				std::println("[master] failed to parse packet");
+		for (const auto& [client, data] : datagrams) {
+			// checked before parsing, so a flooding source neither costs parsing nor creates pending entries
+			if (!m_Admission.Admit(client.address()))
 				continue;
-			}
 
-			using Type = QRPacket::Type;
-			switch (packet->type)
-			{
-			case Type::prequery_ip_verify:
-				co_await HandleAvailable(client, *packet);
-				break;
-			case Type::heartbeat:
-				co_await HandleHeartbeat(client, *packet);
-				break;
-			case Type::keepalive:
-				co_await HandleKeepAlive(client, *packet);
-				break;
-			case Type::challenge:
-				co_await HandleChallenge(client, *packet);
-				break;
-			default:
-				std::println("[master] Unknown MSG {}", std::to_underlying(packet->type));
+			try {
+				auto packet = QRPacket::Parse(data);
+				if (!packet) {
+					std::println("[master] failed to parse packet");
+					continue;
+				}
+
+				using Type = QRPacket::Type;
+				switch (packet->type)
+				{
+				case Type::prequery_ip_verify:
+					co_await HandleAvailable(client, *packet);
+					break;
+				case Type::heartbeat:
+					co_await HandleHeartbeat(client, *packet);
+					break;
+				case Type::keepalive:
+					co_await HandleKeepAlive(client, *packet);
+					break;
+				case Type::challenge:
+					co_await HandleChallenge(client, *packet);
+					break;
+				default:
+					std::println("[master] Unknown MSG {}", std::to_underlying(packet->type));
+				}
 			}
+			catch (std::exception& ex) {
+				std::println("[master] exception: {}", ex.what());
+			}
+		}
+
+		// the replies (challenges, acks, availability) of the whole batch are sent at once (by the sender)
+		m_Datagrams.Flush();
+	}
+}
+namespace {
+	task<std::vector<std::pair<EndpointKey, MasterSnapshot::Server>>> collect(MasterServer& shard)
+	{
+		co_return shard.GetSnapshot();
+	}
+}
+
+MasterSnapshot::MasterSnapshot(boost::asio::io_context& context, GameDB& db, std::filesystem::path file)
+	: m_DB{ db }, m_File{ std::move(file) }, m_Timer{ context }
+{
+
+}
+
+void MasterSnapshot::AddShard(MasterServer& shard)
+{
+	m_Shards.push_back(&shard);
+}
+
+boost::asio::awaitable<void> MasterSnapshot::Load()
+{
+	auto error = std::error_code{};
+	if (std::filesystem::file_size(m_File, error) == 0 || error)
+		co_return;
+
+	namespace ipc = boost::interprocess;
+	auto mapping = std::optional<ipc::file_mapping>{};
+	auto region = std::optional<ipc::mapped_region>{};
+	try {
+		mapping.emplace(m_File.string().c_str(), ipc::read_only);
+		region.emplace(*mapping, ipc::read_only);
+	}
+	catch (const ipc::interprocess_exception& e) {
+		std::println("[master][snapshot] failed to map {}: {}", m_File.string(), e.what());
+		co_return;
+	}
+
+	auto reader = ::SnapshotReader{ { static_cast<const std::uint8_t*>(region->get_address()), region->get_size() } };
+	const auto& magic = reader.read(::snapshot_magic.size());
+	if (!reader || !std::ranges::equal(magic, ::snapshot_magic, {}, {}, [](char c) { return static_cast<std::uint8_t>(c); })) {
+		std::println("[master][snapshot] ignoring {}: unknown format", m_File.string());
+		co_return;
+	}
+
+	const auto now = Clock::now();
+	const auto steadyNow = ExpiryClock::now();
+	auto heartbeat = QRHeartbeatPacket{};
+	for (auto i = reader.read<std::uint32_t>(); reader && i > 0; i--) {
+		const auto key = reader.read<EndpointKey>();
+		const auto lastUpdate = Clock::time_point{ std::chrono::milliseconds{ reader.read<std::int64_t>() } };
+		auto instance = std::array<std::uint8_t, 4>{};
+		std::ranges::copy(reader.read(instance.size()), instance.begin());
+		const auto nameSize = reader.read<std::uint16_t>();
+		const auto payloadSize = reader.read<std::uint32_t>();
+		const auto& name = reader.read(nameSize);
+		const auto& payload = reader.read(payloadSize);
+		if (!reader) {
+			std::println("[master][snapshot] {} is truncated", m_File.string());
+			break;
+		}
+
+		const auto gamename = std::string_view{ reinterpret_cast<const char*>(name.data()), name.size() };
+		if (key == 0 || m_Restored.find(key) || !co_await m_DB.HasGame(gamename))
+			continue;
+
+		const auto game = co_await m_DB.GetGame(gamename);
+		if (lastUpdate + game->serverTimeout() <= now)
+			continue;
+
+		if (!heartbeat.Parse(QRPacket{ .type = QRPacket::Type::heartbeat, .instance = instance, .data = payload }))
+			continue;
+
+		const auto endpoint = endpoint_from_key(key);
+		auto addr = endpoint.address().to_string();
+		auto server = Game::IncomingServer{
+			.last_update = now,
+			.public_ip = addr,
+			.public_port = endpoint.port(),
+			.data = { std::from_range, heartbeat.serverData() }
+		};
+
+		// this runs on the executor of the games and the writes are only queued, so all restored servers of a game are
+		// applied in its write batches (the views of the heartbeat stay valid, the calls do not suspend)
+		const auto map = heartbeat.find("mapname").value_or("");
+		co_await game->AddOrUpdateServer(server);
+		co_await game->UpdatePlayers(addr, endpoint.port(), map, heartbeat.players());
+
+		auto [restored, inserted] = m_Restored.try_emplace(key);
+		*restored = Server{
+			.game = game,
+			.last_update = steadyNow - std::chrono::duration_cast<ExpiryClock::duration>(now - lastUpdate),
+			.instance = instance,
+			.payload = { payload.begin(), payload.end() },
+			.fingerprint = ::fingerprint(heartbeat.serverData()),
+			.roster_fingerprint = ::fingerprint(heartbeat.players(), map)
+		};
+	}
+
+	m_Unclaimed = m_Restored.size();
+	std::println("[master][snapshot] restored {} servers", m_Restored.size());
+}
+
+boost::asio::awaitable<void> MasterSnapshot::Run()
+{
+	auto lastCheckpoint = ExpiryClock::now();
+	while (true) {
+		m_Timer.expires_after(SWEEP_INTERVAL);
+		const auto& [error] = co_await m_Timer.async_wait(boost::asio::as_tuple);
+		if (error) break;
+
+		co_await RemoveUnclaimed();
+		if (ExpiryClock::now() - lastCheckpoint < SNAPSHOT_INTERVAL)
+			continue;
+
+		try {
+			co_await Checkpoint();
 		}
-		catch (std::exception& ex) {
-			std::println("[master] exception: {}", ex.what());
+		catch (const std::exception& e) {
+			std::println("[master][snapshot] failed to save: {}", e.what());
 		}
+
+		lastCheckpoint = ExpiryClock::now();
+	}
+}
+
+std::optional<MasterSnapshot::Server> MasterSnapshot::Claim(EndpointKey key)
+{
+	// most datagrams are received once all restored servers were claimed (or timed out)
+	if (m_Unclaimed.load(std::memory_order_relaxed) == 0)
+		return std::nullopt;
+
+	auto lock = std::scoped_lock{ m_Mutex };
+	auto restored = m_Restored.find(key);
+	if (!restored)
+		return std::nullopt;
+
+	auto server = std::move(*restored);
+	m_Restored.erase(key);
+	m_Unclaimed = m_Restored.size();
+	return server;
+}
+
+boost::asio::awaitable<void> MasterSnapshot::RemoveUnclaimed()
+{
+	if (m_Unclaimed.load(std::memory_order_relaxed) == 0)
+		co_return;
+
+	const auto now = ExpiryClock::now();
+	auto expired = std::map<std::shared_ptr<Game>, std::vector<udp::endpoint>>{};
+	{
+		auto lock = std::scoped_lock{ m_Mutex };
+		auto keys = std::vector<EndpointKey>{};
+		m_Restored.for_each([&](EndpointKey key, const Server& server) {
+			if (server.last_update + server.game->serverTimeout() > now)
+				return;
+
+			keys.push_back(key);
+			expired[server.game].push_back(endpoint_from_key(key));
+		});
+
+		for (const auto key : keys)
+			m_Restored.erase(key);
+
+		m_Unclaimed = m_Restored.size();
 	}
+
+	// the removals are queued before any shard can add one of the servers again (once its claim failed),
+	// the games are running on this executor and RemoveServers does not suspend
+	for (const auto& [game, endpoints] : expired) {
+		auto addrs = std::vector<std::string>{};
+		auto servers = std::vector<std::pair<std::string_view, std::uint16_t>>{};
+		addrs.reserve(endpoints.size());
+		servers.reserve(endpoints.size());
+		for (const auto& endpoint : endpoints) {
+			addrs.push_back(endpoint.address().to_string());
+			servers.emplace_back(addrs.back(), endpoint.port());
+			std::println("[master][server][{}] {}:{} timed out (restored)", game->name(), addrs.back(), endpoint.port());
+		}
+
+		co_await game->RemoveServers(servers);
+	}
+}
+
+std::vector<std::pair<EndpointKey, MasterSnapshot::Server>> MasterSnapshot::GetUnclaimed()
+{
+	auto servers = std::vector<std::pair<EndpointKey, Server>>{};
+	auto lock = std::scoped_lock{ m_Mutex };
+	m_Restored.for_each([&](EndpointKey key, const Server& server) {
+		servers.emplace_back(key, server);
+	});
+
+	return servers;
+}
+
+boost::asio::awaitable<void> MasterSnapshot::Checkpoint()
+{
+	// the unclaimed servers are collected first: a server claimed meanwhile is then written twice (and loaded once) instead of not at all
+	auto servers = GetUnclaimed();
+	for (auto shard : m_Shards) {
+		auto validated = co_await ::run_on(shard->get_executor(), ::collect(*shard));
+		servers.insert(servers.end(), std::make_move_iterator(validated.begin()), std::make_move_iterator(validated.end()));
+	}
+
+	Write(servers);
+}
+
+void MasterSnapshot::Save()
+{
+	try {
+		auto servers = GetUnclaimed();
+		for (auto shard : m_Shards) {
+			auto validated = shard->GetSnapshot();
+			servers.insert(servers.end(), std::make_move_iterator(validated.begin()), std::make_move_iterator(validated.end()));
+		}
+
+		Write(servers);
+	}
+	catch (const std::exception& e) {
+		std::println("[master][snapshot] failed to save: {}", e.what());
+	}
+}
+
+void MasterSnapshot::Write(const std::vector<std::pair<EndpointKey, Server>>& servers)
+{
+	// written next to the snapshot and then renamed, so that a crash while saving keeps the previous snapshot
+	auto temporary = m_File;
+	temporary += ".tmp";
+
+	auto file = std::ofstream{ temporary, std::ios::binary | std::ios::trunc };
+	if (!file)
+		throw std::runtime_error{ std::format("failed to open {}", temporary.string()) };
+
+	// the last updates are saved as wall clock time (the monotonic clock restarts with the system)
+	const auto now = Clock::now();
+	const auto steadyNow = ExpiryClock::now();
+	file.write(::snapshot_magic.data(), ::snapshot_magic.size());
+	::write_value(file, static_cast<std::uint32_t>(servers.size()));
+	for (const auto& [key, server] : servers) {
+		const auto& name = server.game->name();
+		::write_value(file, key);
+		const auto lastUpdate = now - std::chrono::duration_cast<Clock::duration>(steadyNow - server.last_update);
+		::write_value(file, static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(lastUpdate.time_since_epoch()).count()));
+		file.write(reinterpret_cast<const char*>(server.instance.data()), server.instance.size());
+		::write_value(file, static_cast<std::uint16_t>(name.size()));
+		::write_value(file, static_cast<std::uint32_t>(server.payload.size()));
+		file.write(name.data(), name.size());
+		file.write(reinterpret_cast<const char*>(server.payload.data()), server.payload.size());
+	}
+
+	file.close();
+	if (!file)
+		throw std::runtime_error{ std::format("failed to write {}", temporary.string()) };
+
+	std::filesystem::rename(temporary, m_File);
 }
@@ -2,43 +2,155 @@
 #include "gamedb.h"
 #include "game.h"
 #include "asio.h"
+#include "admission.h"
+#include "datagram.h"
+#include "endpoint_table.h"
+#include "qr.h"
+#include "timing_wheel.h"
 #include <array>
+#include <atomic>
 #include <chrono>
-#include <map>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <string>
+#include <span>
+#include <string_view>
 #include <vector>
 
 namespace gamespy {
-	struct QRPacket;
+	class MasterServer;
+
+	// the validated servers of all master shards are checkpointed into a single snapshot file which is loaded before the
+	// first datagram is received, so that a restart neither empties the server lists nor requires all servers to be validated again.
+	// the kernel assigns the servers to the shards by their address, which changes with the number of shards. the restored
+	// servers are therefore not assigned up front: they are claimed by the shard which receives their first heartbeat or
+	// keepalive, the unclaimed ones are removed from their games once they timed out
+	class MasterSnapshot {
+	public:
+		using ExpiryClock = std::chrono::steady_clock;
+
+		// a validated server of a shard or a restored (unclaimed) one
+		struct Server
+		{
+			std::shared_ptr<Game> game;
+			ExpiryClock::time_point last_update;
+			std::array<std::uint8_t, 4> instance;
+			std::vector<std::uint8_t> payload; // the last stored heartbeat
+			std::uint64_t fingerprint = 0; // restored servers only: see MasterServer::server
+			std::uint64_t roster_fingerprint = 0;
+		};
+
+	private:
+		static constexpr std::chrono::seconds SNAPSHOT_INTERVAL{ 30 };
+		static constexpr std::chrono::seconds SWEEP_INTERVAL{ 1 };
+
+		GameDB& m_DB;
+		std::filesystem::path m_File;
+		std::vector<MasterServer*> m_Shards;
+		boost::asio::steady_timer m_Timer;
+
+		// the restored servers which were not claimed yet, accessed by all shards
+		std::mutex m_Mutex;
+		EndpointTable<Server> m_Restored;
+		std::atomic<std::size_t> m_Unclaimed = 0; // checked without locking
+
+	public:
+		// runs on the context of the games
+		MasterSnapshot(boost::asio::io_context& context, GameDB& db, std::filesystem::path file);
+
+		void AddShard(MasterServer& shard);
+
+		// restores the servers into their games, before the shards are started
+		boost::asio::awaitable<void> Load();
+
+		// saves the snapshot periodically and removes the unclaimed servers which timed out
+		boost::asio::awaitable<void> Run();
+
+		// collects the servers directly from the shards, which must not be running (e.g. on shutdown)
+		void Save();
+
+		// thread-safe, called by the shard which received a datagram of an unknown server
+		std::optional<Server> Claim(EndpointKey key);
+
+	private:
+		boost::asio::awaitable<void> Checkpoint();
+		boost::asio::awaitable<void> RemoveUnclaimed();
+		void Write(const std::vector<std::pair<EndpointKey, Server>>& servers);
+		std::vector<std::pair<EndpointKey, Server>> GetUnclaimed();
+	};
 
 	// query and reporting server:
 	// - handles "available" requests (%s.available.gamespy.com)
 	// - endpoint to register game servers (master.gamepsy.com)
+	//
+	// multiple instances (shards) can share the port when constructed with shared=true (SO_REUSEPORT).
+	// the kernel distributes the datagrams by their source address, so all packets of a game server
+	// (heartbeat, challenge, keepalive) are received by the same shard and its state stays shard-local
 	class MasterServer {
 		static constexpr std::uint16_t PORT = 27900;
 
 		boost::asio::ip::udp::socket m_Socket;
+		DatagramBatch m_Datagrams;
+		Admission m_Admission; // per shard: each shard runs on its own thread
 		GameDB& m_DB;
 
+		// the games are not thread-safe, all calls which modify them are executed on this executor
+		boost::asio::any_io_executor m_GameExecutor;
+
+		// the expiry is measured with the monotonic clock, so that wall clock jumps neither expire nor freeze the servers
+		using ExpiryClock = std::chrono::steady_clock;
+
+		// fixed-size entry for both pending (awaiting validation) and validated servers
 		struct server {
-			Clock::time_point last_update;
-			std::string proof;
+			static constexpr auto no_payload = std::numeric_limits<std::uint32_t>::max();
+
+			ExpiryClock::time_point last_update;
+			std::array<char, 32> proof; // base64 of the challenge response (21 bytes => 28 characters)
+			std::uint8_t proof_length;
+			bool validated;
+			std::uint16_t game; // index into m_Games
 			std::array<std::uint8_t, 4> instance;
-			std::string gamename;
-			std::map<std::string, std::string> values;
+			std::uint32_t payload = no_payload; // index into m_Payloads: pending servers (parsed once validated), validated servers if the snapshot is enabled (the last stored heartbeat)
+			std::uint64_t fingerprint; // validated servers only: hash of the data of the last stored heartbeat
+			std::uint64_t roster_fingerprint; // validated servers only: hash of the players (and map) of the last stored heartbeat
+			std::uint32_t expires; // deadline of the live m_Expiry record (older records of this endpoint are ignored)
 		};
 
-		std::map<boost::asio::ip::udp::endpoint, server> m_AwaitingValidation;
-		std::map<boost::asio::ip::udp::endpoint, server> m_Validated;
+		EndpointTable<server> m_Servers;
+		std::vector<std::shared_ptr<Game>> m_Games; // interned games (server::game)
+		std::vector<boost::signals2::scoped_connection> m_GameConnections; // Game::OnServerWriteFailed of the interned games
+
+		// the last heartbeat of pending servers, it is parsed again once the server is validated
+		// (and of validated servers, so that their values can be written into the snapshot)
+		std::vector<std::vector<std::uint8_t>> m_Payloads;
+		std::vector<std::uint32_t> m_FreePayloads;
+
+		// heartbeats and keepalives only refresh server::last_update, the record is rescheduled once it fires
+		// (one second ticks since m_Epoch)
+		using ExpiryWheel = TimingWheel<EndpointKey>;
+		ExpiryClock::time_point m_Epoch;
+		ExpiryWheel m_Expiry;
 		boost::asio::steady_timer m_CleanupTimer;
 
+		QRHeartbeatPacket m_Heartbeat; // reused by every heartbeat (and challenge), so parsing does not allocate (see tests/heartbeat_benchmark.cpp)
+
+		MasterSnapshot* m_Snapshot; // shared by all shards (optional)
+
 	public:
-		MasterServer(boost::asio::io_context& context, GameDB& db);
+		MasterServer(boost::asio::io_context& context, const Admission::Config& admission, GameDB& db, boost::asio::any_io_executor gameExecutor, bool shared, MasterSnapshot* snapshot = nullptr);
 		~MasterServer();
 
 		boost::asio::awaitable<void> Run();
 
+		// the validated servers for the snapshot, called on the executor of this shard
+		std::vector<std::pair<EndpointKey, MasterSnapshot::Server>> GetSnapshot();
+		auto get_executor() { return m_Socket.get_executor(); }
+
+		auto& replyStats() const noexcept { return m_Datagrams.stats(); }
+		auto& admissionStats() const noexcept { return m_Admission.stats(); }
+
 	private:
 		boost::asio::awaitable<void> AcceptConnections();
 
@@ -47,5 +159,17 @@ namespace gamespy {
 		boost::asio::awaitable<void> HandleKeepAlive(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
 		boost::asio::awaitable<void> HandleChallenge(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
 		boost::asio::awaitable<void> Cleanup();
+		boost::asio::awaitable<void> RemoveExpired(const std::shared_ptr<Game>& game, const boost::asio::ip::udp::endpoint& endpoint);
+
+		// takes over a restored server (see MasterSnapshot::Claim), returns its entry
+		boost::asio::awaitable<server*> ClaimRestored(EndpointKey key);
+
+		boost::asio::awaitable<std::optional<std::uint16_t>> GetGameId(const std::string_view& gamename);
+		std::uint32_t StorePayload(std::span<const std::uint8_t> payload);
+		void StorePayload(server& server, std::span<const std::uint8_t> payload); // replaces the payload of the server
+		void ReleasePayload(std::uint32_t payload);
+
+		ExpiryWheel::Tick GetTick(ExpiryClock::time_point time) const;
+		ExpiryWheel::Tick GetDeadline(const server& server) const;
 	};
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include "gamedb.h"
 #include "master.h"
+#include "ms.h"
 #include "ms.client.h"
 #include "sapphire.h"
 #include "sb_request.h"
 #include "utils.h"
+#include <algorithm>
 #include <print>
 #include <type_traits>
 #include <boost/asio/experimental/awaitable_operators.hpp>
@@ -53,26 +55,17 @@ namespace {
 			}
 		}
 	}
-
-	boost::asio::experimental::coro<std::vector<std::uint8_t>> channel_reader(boost::asio::ip::tcp::socket& sock, boost::asio::experimental::channel<void(boost::system::error_code, std::vector<std::uint8_t>)>& channel)
-	{
-		while (sock.is_open()) {
-			const auto& [error, bytes] = co_await channel.async_receive(boost::asio::as_tuple);
-			if (error) break;
-			co_yield bytes;
-		}
-	}
 }
 
-BrowserClient::BrowserClient(boost::asio::ip::tcp::socket socket, GameDB& db)
-	: m_Socket(std::move(socket)), m_DB(db), m_SignalChannel(m_Socket.get_executor(), 10)
+BrowserClient::BrowserClient(boost::asio::ip::tcp::socket socket, BrowserServer& server, GameDB& db)
+	: m_Socket(std::move(socket)), m_Server(server), m_DB(db), m_PushSignal(m_Socket.get_executor(), boost::asio::steady_timer::time_point::max())
 {
 
 }
 
 BrowserClient::~BrowserClient()
 {
-
+	m_Server.pushStats().dropped.fetch_add(m_PendingUpdates.size(), std::memory_order_relaxed);
 }
 
 boost::asio::awaitable<void> BrowserClient::StartEncryption(const decltype(ServerListRequest::challenge)& clientChallenge, const Game& game)
@@ -108,6 +101,23 @@ boost::asio::awaitable<void> BrowserClient::StartEncryption(const decltype(Serve
 	co_await m_Socket.async_send(boost::asio::buffer(data), boost::asio::use_awaitable);
 }
 
+boost::asio::awaitable<void> BrowserClient::Commit(std::size_t offset)
+{
+	m_Cypher->encrypt(std::span(m_OutBuffer).subspan(offset));
+	if (m_OutBuffer.size() >= OUT_BUFFER_SIZE)
+		co_await Flush();
+}
+
+boost::asio::awaitable<void> BrowserClient::Flush()
+{
+	if (m_OutBuffer.empty())
+		co_return;
+
+	co_await boost::asio::async_write(m_Socket, boost::asio::buffer(m_OutBuffer), boost::asio::use_awaitable);
+	m_OutBuffer.clear();
+	m_LastWrite = std::chrono::steady_clock::now();
+}
+
 boost::asio::awaitable<void> BrowserClient::Process()
 {
 	auto reader = ::packet_reader(m_Socket);
@@ -122,34 +132,112 @@ boost::asio::awaitable<void> BrowserClient::Process()
 
 	co_await HandleServerListRequest(packet.data);
 
-	auto adhock = ::channel_reader(m_Socket, m_SignalChannel);
 	while (m_Socket.is_open()) {
-		// do not use two coroutines here because we do not want to interleave sending data from the channel and
-		// sending data generated from the packet handling
+		if (!m_PendingUpdates.empty()) {
+			co_await SendPendingUpdates();
+			continue;
+		}
+
+		// do not use two coroutines here because we do not want to interleave sending the adhoc data (server added/removed)
+		// and sending data generated from the packet handling
 		using namespace boost::asio::experimental::awaitable_operators;
 		auto incoming = co_await (
-			adhock.async_resume(boost::asio::use_awaitable)
+			m_PushSignal.async_wait(boost::asio::as_tuple(boost::asio::use_awaitable))
 			|| reader.async_resume(boost::asio::use_awaitable)
 		);
 
-		if (incoming.index() == 0) {
-			// adhoc data (server added/removed)
-			auto& _bytes = std::get<0>(incoming);
-			if (!_bytes) break;
-
-			auto& bytes = *_bytes;
-			m_Cypher->encrypt(bytes);
-			co_await m_Socket.async_send(boost::asio::buffer(bytes), boost::asio::use_awaitable);
-		}
+		if (incoming.index() == 0)
+			continue; // woken up by an update
 
 		auto& _packet = std::get<1>(incoming);
 		if (!_packet) break;
 		const auto& packet = *_packet;
 
-		// TODO: bf2 is using the serverbrowsing with disconnectOnComplete=true, so no other types are expected
-		// I figured this out *after* implementing the adhoc (server added/removed) mechanism ...
-		std::println("[browser] received unhandled packet {:2X}", std::to_underlying(packet.type));
+		using Type = ServerBrowsingPacket::Type;
+		switch (packet.type) {
+		case Type::server_info_request:
+			co_await HandleServerInfoRequest(packet.data);
+			break;
+		case Type::playersearch_request:
+			co_await HandlePlayerSearchRequest(packet.data);
+			break;
+		default:
+			// TODO: bf2 is using the serverbrowsing with disconnectOnComplete=true, so no other types are expected
+			// I figured this out *after* implementing the adhoc (server added/removed) mechanism ...
+			std::println("[browser] received unhandled packet {:2X}", std::to_underlying(packet.type));
+		}
+	}
+}
+
+boost::asio::awaitable<void> BrowserClient::SendPendingUpdates()
+{
+	// updates queued while sending are sent with the next batch
+	auto updates = std::exchange(m_PendingUpdates, {});
+	for (const auto& [server, message] : updates)
+		co_await Write(*message); // the shared plaintext is copied into the output buffer and encrypted there
+
+	co_await Flush();
+	m_Server.pushStats().sent.fetch_add(updates.size(), std::memory_order_relaxed);
+}
+
+boost::asio::awaitable<void> BrowserClient::HandleServerInfoRequest(const std::span<const std::uint8_t>& bytes)
+{
+	const auto request = ServerInfoRequest::Parse(bytes);
+	if (!request) {
+		std::println("[browser] packet of type SERVER_INFO_REQUEST is invalid {}", std::to_underlying(request.error()));
+		m_Socket.close();
+		co_return;
+	}
+
+	// answered from the last heartbeat, so that clients do not need to query the server (which fails behind nat)
+	const auto ip = request->ip.to_string();
+	const auto server = co_await m_Game->GetServer(ip, request->port);
+	if (!server) {
+		std::println("[browser] requested info of unknown server {}:{}", ip, request->port);
+		co_return;
+	}
+
+	const auto fields = m_FieldList | std::ranges::to<std::vector<std::string_view>>();
+	co_await Send(ServerInfoRequest::GetResponseBytes(*m_Game, *server, fields));
+}
+
+boost::asio::awaitable<void> BrowserClient::HandlePlayerSearchRequest(const std::span<const std::uint8_t>& bytes)
+{
+	const auto request = PlayerSearchRequest::Parse(bytes);
+	if (!request) {
+		std::println("[browser] packet of type PLAYERSEARCH_REQUEST is invalid {}", std::to_underlying(request.error()));
+		m_Socket.close();
+		co_return;
 	}
+
+	using Options = PlayerSearchRequest::Options;
+	if (request->options & Options::right_substring || request->options & Options::any_substring) {
+		// the roster can only be searched by exact names and prefixes
+		std::println("[browser] unsupported player search options {}", std::to_underlying(request->options));
+		co_await Send(PlayerSearchRequest::GetResponseBytes({}));
+		co_return;
+	}
+
+	auto games = std::vector<std::shared_ptr<Game>>{ m_Game };
+	if (request->options & Options::all_games)
+		games = co_await m_DB.GetGames();
+
+	const auto limit = std::min<std::uint32_t>(request->maxResults, 500);
+	auto results = std::vector<std::pair<const Game*, PlayerRoster::Player>>{};
+	for (const auto& game : games) {
+		const auto& roster = game->roster();
+		const auto& players = request->options & Options::left_substring
+			? roster.FindPlayersByPrefix(request->name, limit - results.size())
+			: roster.FindPlayers(request->name);
+
+		for (const auto& player : players | std::views::take(limit - results.size()))
+			results.emplace_back(game.get(), player);
+
+		if (results.size() >= limit)
+			break;
+	}
+
+	co_await Send(PlayerSearchRequest::GetResponseBytes(results));
 }
 
 boost::asio::awaitable<void> BrowserClient::HandleServerListRequest(const std::span<const std::uint8_t>& bytes)
@@ -168,55 +256,98 @@ boost::asio::awaitable<void> BrowserClient::HandleServerListRequest(const std::s
 	}
 
 	m_Game = co_await m_DB.GetGame(request->toGame);
+	m_FieldList.assign_range(request->fieldList);
 	co_await StartEncryption(request->challenge, *m_Game);
 
-	co_await Send(request->GetResponseHeaderBytes(*m_Game, m_Socket.remote_endpoint().address().to_v4()));
-
 	using Options = ServerListRequest::Options;
-	if (request->options & Options::no_server_list || m_Game->queryPort() == 0xFFFF)
-		co_return;
+	const auto sendList = !(request->options & Options::no_server_list) && m_Game->queryPort() != 0xFFFF
+		&& !(request->options & Options::send_groups); // groups are not yet implemented
+
+	// the first servers (all of them for the common, small results) are shared between identical requests,
+	// the rest of larger lists is streamed from a cursor which continues after the shared servers
+	auto servers = std::shared_ptr<const std::vector<Game::SavedServer>>{};
+	auto cursor = std::optional<Game::ServerCursor>{};
+	const auto limit = std::min<std::uint32_t>(request->limitResultCount.value_or(MAX_LIST_SERVERS), MAX_LIST_SERVERS);
+	if (sendList && !(request->options & Options::no_list_cache))
+		servers = co_await m_Server.GetServers(*m_Game, request->serverFilter, request->fieldList, std::min<std::size_t>(limit, CACHED_LIST_SERVERS));
+
+	if (sendList && (!servers || (servers->size() == CACHED_LIST_SERVERS && limit > CACHED_LIST_SERVERS))) {
+		cursor = co_await m_Game->OpenServers(request->serverFilter, request->fieldList);
+		if (cursor && servers)
+			cursor->SkipPast(servers->back());
+	}
 
-	if (request->options & Options::send_groups)
-		co_return; // not yet implemented
-	
-	// a non-pushed server list is expected to contain the popular fields
-	auto limit = std::min<std::uint32_t>(request->limitResultCount.value_or(500), 500);
-	for (auto& server : co_await m_Game->GetServers(request->serverFilter, request->fieldList, limit)) {
-		constexpr bool usePopularFields = true;
-		co_await Send(ServerListRequest::GetServerBytes(*m_Game, server, request->fieldList, usePopularFields));
+	// the header contains the popular values the records refer to, so both are serialized without suspending in between
+	auto offset = m_OutBuffer.size();
+	m_OutBuffer.append_range(request->GetResponseHeaderBytes(*m_Game, m_Socket.remote_endpoint().address().to_v4()));
+	if (sendList) {
+		// a non-pushed server list is expected to contain the popular fields
+		auto usePopularFields = true;
+		const auto popularValues = m_Game->GetPopularValuesVersion();
+		auto& cache = m_Server.GetRecordCache(*m_Game);
+		cache.CheckPopularValues(*m_Game);
+
+		auto fieldListHash = ServerRecordCache::HashFieldList(request->fieldList, usePopularFields);
+		auto count = std::size_t{ 0 };
+		if (servers) {
+			for (const auto& server : *servers)
+				cache.AppendServerBytes(m_OutBuffer, *m_Game, server, request->fieldList, fieldListHash, usePopularFields);
+
+			count = servers->size();
+		}
+
+		if (cursor) {
+			auto server = Game::SavedServer{};
+			for (; count < limit && cursor->Next(server); count++) {
+				cache.AppendServerBytes(m_OutBuffer, *m_Game, server, request->fieldList, fieldListHash, usePopularFields);
+				if (m_OutBuffer.size() < OUT_BUFFER_SIZE)
+					continue;
+
+				co_await Commit(offset);
+				offset = m_OutBuffer.size();
+
+				// the header refers to the popular values at the time it was built, if they were changed while
+				// sending, the remaining servers are sent with their full values
+				if (usePopularFields && m_Game->GetPopularValuesVersion() != popularValues) {
+					usePopularFields = false;
+					fieldListHash = ServerRecordCache::HashFieldList(request->fieldList, usePopularFields);
+				}
+
+				cache.CheckPopularValues(*m_Game);
+			}
+		}
+
+		m_OutBuffer.append_range(std::array<std::uint8_t, 5>{ 0x00, 0xFF, 0xFF, 0xFF, 0xFF });
 	}
 
-	co_await Send(std::array<std::uint8_t, 5>{ 0x00, 0xFF, 0xFF, 0xFF, 0xFF });
+	co_await Commit(offset);
+	co_await Flush();
+	if (!sendList)
+		co_return;
 
 	// configure adhoc updates
 	if (request->options & Options::push_updates) {
 		// the field-list contains the list of keys the client wants to receive for adhoc updates
-		for (const auto& field : request->fieldList) {
-			const auto& fieldStr = m_KeyListStorage.emplace_back(field);
-			m_KeyList.emplace_back(fieldStr);
-		}
-
-		m_OnServerAdded = m_Game->OnServerAdded.connect([this](const Game::IncomingServer& server) {
-			auto serverBytes = ServerListRequest::GetServerBytes(*m_Game, server, m_KeyList, false);
-			std::vector<std::uint8_t> bytes;
-			bytes.push_back(0x02); // PUSH_SERVER_MESSAGE
-			bytes.push_back(static_cast<std::uint8_t>(serverBytes.size() >> 8));
-			bytes.push_back(static_cast<std::uint8_t>(serverBytes.size()));
-			bytes.append_range(serverBytes);
-			m_SignalChannel.try_send(boost::system::error_code{}, bytes);
-		});
+		// a newer update of a server replaces the pending one, so that slow clients still end up with the latest state
+		m_PushUpdates = m_Server.SubscribePushUpdates(*m_Game, request->fieldList, [this](EndpointKey server, const BrowserServer::PushMessage& message) {
+			auto& stats = m_Server.pushStats();
+			const auto now = std::chrono::steady_clock::now();
+			if (m_PendingUpdates.empty())
+				m_PendingSince = now;
+
+			if (!m_PendingUpdates.insert_or_assign(server, message).second)
+				stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+
+			// the pending updates are bounded by the servers of the game, a client is only dropped once its writes stopped
+			// progressing: neither were the updates sent nor did a write complete since they were queued
+			if (now - std::max(m_PendingSince, m_LastWrite) > MAX_WRITE_STALL) {
+				std::println("[browser] disconnecting client with {} pending updates (no write progress)", m_PendingUpdates.size());
+				stats.disconnected.fetch_add(1, std::memory_order_relaxed);
+				m_PushUpdates.disconnect();
+				m_Socket.close();
+			}
 
-		m_OnServerRemoved = m_Game->OnServerRemoved.connect([this](const std::string_view& ip, std::uint16_t port) {
-			std::vector<std::uint8_t> bytes;
-			bytes.push_back(0x04); // DELETE_SERVER_MESSAGE
-			bytes.push_back(0);
-			bytes.push_back(6); // 6 bytes for ip and port
-			bytes.append_range(boost::asio::ip::make_address_v4(ip).to_bytes());
-			bytes.append_range(std::array{
-				static_cast<std::uint8_t>(port >> 8),
-				static_cast<std::uint8_t>(port)
-				});
-			m_SignalChannel.try_send(boost::system::error_code{}, bytes);
+			m_PushSignal.cancel();
 		});
 	}
 }
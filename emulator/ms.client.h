@@ -3,39 +3,51 @@
 #define _GAMESPY_BROWSER_CLIENT_H_
 
 #include "asio.h"
+#include "endpoint_table.h"
 #include "sapphire.h"
 #include "sb_request.h"
-#include <boost/asio/experimental/channel.hpp>
 #include <boost/signals2.hpp>
+#include <chrono>
 #include <concepts>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
 #include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace gamespy {
+	class BrowserServer;
 	class GameDB;
 	class Game;
 	class BrowserClient {
+		static constexpr std::size_t OUT_BUFFER_SIZE = 64 * 1024;
+		static constexpr auto MAX_WRITE_STALL = std::chrono::seconds{ 30 }; // clients with pending updates which did not complete a write for this long are disconnected
+		static constexpr std::size_t MAX_LIST_SERVERS = 10000;
+		static constexpr std::size_t CACHED_LIST_SERVERS = 500; // shared between identical requests, the rest of larger lists is streamed
+
 		boost::asio::ip::tcp::socket m_Socket;
+		BrowserServer& m_Server;
 		GameDB& m_DB;
 
 		std::optional<sapphire> m_Cypher;
 		std::shared_ptr<Game> m_Game;
-		std::vector<std::string> m_KeyListStorage;
-		std::vector<std::string_view> m_KeyList; // points to m_KeyListStorage
-		std::vector<std::uint8_t> m_OutBuffer;
-		boost::signals2::scoped_connection m_OnServerAdded, m_OnServerRemoved;
-		boost::asio::experimental::channel<void(boost::system::error_code, std::vector<std::uint8_t>)> m_SignalChannel;
+		std::vector<std::string> m_FieldList; // of the server list request, the server info responses contain the same fields
+		std::vector<std::uint8_t> m_OutBuffer; // encrypted, not yet written bytes (reused between writes)
+		boost::signals2::scoped_connection m_PushUpdates;
+		std::map<EndpointKey, std::shared_ptr<const std::vector<std::uint8_t>>> m_PendingUpdates; // latest update per server (bounded by the servers of the game)
+		std::chrono::steady_clock::time_point m_PendingSince; // when the first of m_PendingUpdates was queued
+		std::chrono::steady_clock::time_point m_LastWrite; // when the last write completed
+		boost::asio::steady_timer m_PushSignal; // cancelled when an update is queued
 
 	public:
 		BrowserClient(BrowserClient&& rhs) = default;
 		BrowserClient& operator=(BrowserClient&& rhs) = default;
 
-		BrowserClient(boost::asio::ip::tcp::socket socket, GameDB &db);
+		BrowserClient(boost::asio::ip::tcp::socket socket, BrowserServer& server, GameDB &db);
 		~BrowserClient();
 
 		boost::asio::awaitable<void> Process();
@@ -43,12 +55,27 @@ namespace gamespy {
 	private:
 		boost::asio::awaitable<void> StartEncryption(const decltype(ServerListRequest::challenge)& clientChallenge, const Game& game);
 		boost::asio::awaitable<void> HandleServerListRequest(const std::span<const std::uint8_t>& bytes);
+		boost::asio::awaitable<void> HandleServerInfoRequest(const std::span<const std::uint8_t>& bytes);
+		boost::asio::awaitable<void> HandlePlayerSearchRequest(const std::span<const std::uint8_t>& bytes);
+		boost::asio::awaitable<void> SendPendingUpdates();
+
+		// encrypts everything appended to m_OutBuffer after offset, the buffer is written once it is full
+		boost::asio::awaitable<void> Commit(std::size_t offset);
+		boost::asio::awaitable<void> Flush();
+
+		template<class R> requires std::ranges::range<R> && std::same_as<std::ranges::range_value_t<R>, unsigned char>
+		boost::asio::awaitable<void> Write(R&& bytes)
+		{
+			const auto offset = m_OutBuffer.size();
+			m_OutBuffer.append_range(bytes);
+			co_await Commit(offset);
+		}
 
 		template<class R> requires std::ranges::range<R> && std::same_as<std::ranges::range_value_t<R>, unsigned char>
 		boost::asio::awaitable<void> Send(R&& bytes)
 		{
-			m_Cypher->encrypt(bytes);
-			co_await m_Socket.async_send(boost::asio::buffer(bytes), boost::asio::use_awaitable);
+			co_await Write(std::forward<R>(bytes));
+			co_await Flush();
 		}
 	};
 }
@@ -1,11 +1,15 @@
 #include "ms.h"
+#include "admission.h"
+#include "game.h"
 #include "ms.client.h"
+#include <array>
+#include <format>
 #include <print>
 #include <utility>
 using namespace gamespy;
 
-BrowserServer::BrowserServer(boost::asio::io_context& context, GameDB& db)
-	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)),  m_DB(db)
+BrowserServer::BrowserServer(boost::asio::io_context& context, Admission& admission, GameDB& db)
+	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)), m_Admission(admission),  m_DB(db)
 {
 	std::println("[browser] starting up: {} TCP", PORT);
 	std::println("[browser] (%s.ms%d.gamespy.com)");
@@ -23,14 +27,145 @@ boost::asio::awaitable<void> BrowserServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		boost::asio::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), boost::asio::detached);
 	}
 }
 
+BrowserServer::GameCache& BrowserServer::GetGameCache(Game& game)
+{
+	auto [cache, inserted] = m_Caches.try_emplace(&game);
+	if (inserted) {
+		auto& records = cache->second.records;
+		cache->second.onServerAdded = game.OnServerAdded.connect([&records](const Game::IncomingServer& server) {
+			records.Remove(server.public_ip, server.public_port);
+		});
+
+		cache->second.onServerRemoved = game.OnServerRemoved.connect([&records](const std::string_view& ip, std::uint16_t port) {
+			records.Remove(ip, port);
+		});
+	}
+
+	return cache->second;
+}
+
+ServerRecordCache& BrowserServer::GetRecordCache(Game& game)
+{
+	return GetGameCache(game).records;
+}
+
+boost::asio::awaitable<std::shared_ptr<const std::vector<Game::SavedServer>>> BrowserServer::GetServers(Game& game, const std::string_view& filter, const std::vector<std::string_view>& fields, std::size_t limit)
+{
+	// length-prefixed, so that no filter (which may contain any character) can be mistaken for another filter and fields
+	auto key = std::format("{}:{}:{}", limit, filter.size(), filter);
+	for (const auto& field : fields)
+		key += std::format("{}:{}", field.size(), field);
+
+	auto& queries = GetGameCache(game).queries;
+	if (auto cached = queries.find(key); cached != queries.end() && cached->second->generation == game.generation()) {
+		auto query = cached->second; // the entry might be replaced while waiting
+		while (!query->done)
+			co_await query->finished.async_wait(boost::asio::as_tuple(boost::asio::use_awaitable));
+
+		if (query->servers)
+			co_return query->servers;
+	}
+
+	if (queries.size() >= MAX_CACHED_QUERIES)
+		queries.clear(); // running queries are kept alive by their waiters
+
+	auto query = std::make_shared<ListQuery>(game.generation(), false, nullptr, boost::asio::steady_timer{ m_Acceptor.get_executor(), boost::asio::steady_timer::time_point::max() });
+	queries.insert_or_assign(key, query);
+
+	auto complete = [&queries, &key, &query]() {
+		query->done = true;
+		query->finished.cancel();
+
+		// failed queries (e.g. an invalid filter) are not cached
+		if (!query->servers) {
+			if (auto cached = queries.find(key); cached != queries.end() && cached->second == query)
+				queries.erase(cached);
+		}
+	};
+
+	try {
+		if (auto cursor = co_await game.OpenServers(filter, fields)) {
+			auto servers = std::vector<Game::SavedServer>{};
+			auto server = Game::SavedServer{};
+			while (servers.size() < limit && cursor->Next(server))
+				servers.push_back(server);
+
+			query->servers = std::make_shared<const std::vector<Game::SavedServer>>(std::move(servers));
+		}
+	}
+	catch (...) {
+		complete();
+		throw;
+	}
+
+	complete();
+	co_return query->servers;
+}
+
+boost::signals2::connection BrowserServer::SubscribePushUpdates(Game& game, const std::vector<std::string_view>& fields, PushHandler handler)
+{
+	auto signature = std::string{};
+	for (const auto& field : fields)
+		signature += std::format("\\{}", field);
+
+	auto& groups = GetGameCache(game).pushGroups;
+	std::erase_if(groups, [](const auto& group) { return group.second->OnMessage.empty(); });
+
+	auto& group = groups[signature];
+	if (!group) {
+		group = std::make_unique<PushGroup>();
+		group->fields.assign_range(fields);
+		group->fieldList.assign_range(group->fields);
+
+		group->onServerAdded = game.OnServerAdded.connect([&game, group = group.get()](const Game::IncomingServer& server) {
+			auto error = boost::system::error_code{};
+			const auto address = boost::asio::ip::make_address_v4(server.public_ip, error);
+			if (error)
+				return; // cannot be represented in the message
+
+			auto serverBytes = ServerListRequest::GetServerBytes(game, server, group->fieldList, false);
+			auto bytes = std::vector<std::uint8_t>{};
+			bytes.push_back(0x02); // PUSH_SERVER_MESSAGE
+			bytes.push_back(static_cast<std::uint8_t>(serverBytes.size() >> 8));
+			bytes.push_back(static_cast<std::uint8_t>(serverBytes.size()));
+			bytes.append_range(serverBytes);
+			group->OnMessage(endpoint_key(address, server.public_port), std::make_shared<const std::vector<std::uint8_t>>(std::move(bytes)));
+		});
+
+		group->onServerRemoved = game.OnServerRemoved.connect([group = group.get()](const std::string_view& ip, std::uint16_t port) {
+			auto error = boost::system::error_code{};
+			const auto address = boost::asio::ip::make_address_v4(ip, error);
+			if (error)
+				return; // cannot be represented in the message (and was never pushed)
+
+			auto bytes = std::vector<std::uint8_t>{};
+			bytes.push_back(0x04); // DELETE_SERVER_MESSAGE
+			bytes.push_back(0);
+			bytes.push_back(6); // 6 bytes for ip and port
+			bytes.append_range(address.to_bytes());
+			bytes.append_range(std::array{
+				static_cast<std::uint8_t>(port >> 8),
+				static_cast<std::uint8_t>(port)
+			});
+			group->OnMessage(endpoint_key(address, port), std::make_shared<const std::vector<std::uint8_t>>(std::move(bytes)));
+		});
+	}
+
+	return group->OnMessage.connect(std::move(handler));
+}
+
 boost::asio::awaitable<void> BrowserServer::HandleIncoming(boost::asio::ip::tcp::socket socket)
 {
 	try {
-		BrowserClient client(std::move(socket), m_DB);
+		BrowserClient client(std::move(socket), *this, m_DB);
 		co_await client.Process();
 	}
 	catch (std::exception& e) {
@@ -1,21 +1,89 @@
 #pragma once
 #include "asio.h"
+#include "sb_request.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/signals2.hpp>
 
 namespace gamespy {
+	class Admission;
 	class GameDB;
+	class Game;
 	class BrowserServer {
 		// (legacy "enctype1") runs on 28900 (which is currently not supported and support isn't planned)
 		static constexpr std::uint16_t PORT = 28910; // %s.ms%d.gamespy.com
 		boost::asio::ip::tcp::acceptor m_Acceptor;
+		Admission& m_Admission;
 		GameDB& m_DB;
 
+		static constexpr std::size_t MAX_CACHED_QUERIES = 64; // per game
+
+		// result of a server list query, shared by all identical requests while the game's generation is unchanged
+		struct ListQuery
+		{
+			std::uint64_t generation;
+			bool done = false;
+			std::shared_ptr<const std::vector<Game::SavedServer>> servers; // null if the query failed
+			boost::asio::steady_timer finished; // cancelled once done
+		};
+
 	public:
-		BrowserServer(boost::asio::io_context& context, GameDB& db);
+		using PushMessage = std::shared_ptr<const std::vector<std::uint8_t>>; // plaintext, shared by all subscribers
+		using PushHandler = std::function<void(EndpointKey server, const PushMessage&)>;
+
+		struct PushStats
+		{
+			std::atomic<std::uint64_t> sent;
+			std::atomic<std::uint64_t> coalesced; // replaced by a newer update of the same server before being sent
+			std::atomic<std::uint64_t> dropped; // pending when the client disconnected
+			std::atomic<std::uint64_t> disconnected; // clients which fell too far behind
+		};
+
+	private:
+		// the push updates (server added/removed) of all clients which requested the same fields are serialized once
+		struct PushGroup
+		{
+			std::vector<std::string> fields;
+			std::vector<std::string_view> fieldList; // points to fields
+			boost::signals2::signal<void(EndpointKey, const PushMessage&)> OnMessage;
+			boost::signals2::scoped_connection onServerAdded, onServerRemoved;
+		};
+
+		struct GameCache
+		{
+			ServerRecordCache records;
+			std::map<std::string, std::shared_ptr<ListQuery>, std::less<>> queries;
+			std::map<std::string, std::unique_ptr<PushGroup>, std::less<>> pushGroups; // by field list
+			boost::signals2::scoped_connection onServerAdded, onServerRemoved;
+		};
+		std::map<const Game*, GameCache> m_Caches; // games are never removed from the db
+		PushStats m_PushStats;
+
+	public:
+		BrowserServer(boost::asio::io_context& context, Admission& admission, GameDB& db);
 		~BrowserServer();
 
 		boost::asio::awaitable<void> AcceptClients();
 
+		// shared by all clients of a game, invalidated by the game's server signals
+		ServerRecordCache& GetRecordCache(Game& game);
+
+		// identical queries are answered from the previous result until the game changes,
+		// concurrent identical queries wait for the first one instead of querying the game themselves (null if the query is invalid)
+		boost::asio::awaitable<std::shared_ptr<const std::vector<Game::SavedServer>>> GetServers(Game& game, const std::string_view& filter, const std::vector<std::string_view>& fields, std::size_t limit);
+
+		// the handler receives the PUSH_SERVER_MESSAGE and DELETE_SERVER_MESSAGE messages of the game (containing the given fields)
+		boost::signals2::connection SubscribePushUpdates(Game& game, const std::vector<std::string_view>& fields, PushHandler handler);
+		auto pushStats() -> PushStats& { return m_PushStats; }
+		auto pushStats() const -> const PushStats& { return m_PushStats; }
+
 	private:
+		GameCache& GetGameCache(Game& game);
 		boost::asio::awaitable<void> HandleIncoming(boost::asio::ip::tcp::socket socket);
 	};
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "qr.h"
+#include <algorithm>
 #include <print>
 #include <ranges>
 #include <utility>
@@ -24,85 +25,84 @@ std::expected<QRPacket, QRPacket::ParseError> QRPacket::Parse(const std::span<co
 	};
 }
 
-struct QRMap
-{
-	std::map<std::string_view, std::string_view> data;
+namespace {
+	using ParseError = QRPacket::ParseError;
+	using Iter = std::span<const std::uint8_t>::iterator;
 
-	template<typename Iter = std::forward_iterator_tag>
-	static std::expected<QRMap, QRPacket::ParseError> Parse(Iter& pos, const Iter& end)
+	std::expected<std::string_view, ParseError> next_string(Iter& pos, const Iter& end)
+	{
+		auto strEnd = std::find(pos, end, '\0');
+		if (strEnd == end)
+			return std::unexpected(ParseError::too_small);
+
+		auto str = std::string_view{ reinterpret_cast<const char*>(&*pos), static_cast<std::size_t>(strEnd - pos) };
+		pos = strEnd + 1;
+		return str;
+	}
+
+	// key\0value\0...key\0value\0\0
+	std::expected<void, ParseError> parse_map(Iter& pos, const Iter& end, std::vector<QRHeartbeatPacket::KeyValue>& out)
 	{
-		using ParseError = QRPacket::ParseError;
 		if (pos == end)
 			return std::unexpected(ParseError::too_small);
 
-		std::map<std::string_view, std::string_view> data;
-		std::string_view key;
 		while (pos != end) {
-			auto strEnd = std::find(pos, end, '\0');
-			if (strEnd == end)
-				return std::unexpected(ParseError::too_small);
+			auto key = next_string(pos, end);
+			if (!key)
+				return std::unexpected(key.error());
 
-			auto str = std::string_view{ reinterpret_cast<const char*>(&*pos), reinterpret_cast<const char*>(&*strEnd) };
-			pos = strEnd + 1;
+			// empy key (indicates map is finished)
+			if (key->empty())
+				break;
 
-			if (key.empty()) {
-				if (str.empty()) {
-					// empy string (indicates map is finished)
-					break;
-				}
+			auto value = next_string(pos, end);
+			if (!value)
+				return std::unexpected(value.error());
 
-				std::swap(key, str);
-			}
-			else {
-				data.emplace(key, std::move(str));
-				key = std::string_view{};
-			}
+			out.emplace_back(*key, *value);
 		}
 
-		return QRMap{
-			.data = data
-		};
-	}
-};
+		// insertion sort: stable (so the first occurence of a key is kept) and without a temporary buffer,
+		// heartbeats only contain a few dozen keys
+		for (auto i = out.begin(); i != out.end(); ++i) {
+			auto current = *i;
+			auto j = i;
+			for (; j != out.begin() && std::prev(j)->first > current.first; --j)
+				*j = *std::prev(j);
 
-struct QRTable
-{
-	using row_t = std::vector<std::string_view>;
-	row_t header;
-	std::vector<row_t> rows;
+			*j = current;
+		}
+
+		const auto& duplicates = std::ranges::unique(out, {}, &QRHeartbeatPacket::KeyValue::first);
+		out.erase(duplicates.begin(), duplicates.end());
+		return {};
+	}
 
-	template<typename Iter = std::forward_iterator_tag>
-	static std::expected<QRTable, QRPacket::ParseError> Parse(Iter& pos, const Iter& end, const std::string_view& headerEnd)
+	// (2-byte count) header_\0...header_\0\0 (count * header.size() cells)
+	std::expected<void, ParseError> parse_table(Iter& pos, const Iter& end, const std::string_view& headerEnd, QRHeartbeatPacket::Table& out)
 	{
-		using ParseError = QRPacket::ParseError;
 		if (pos == end)
 			return std::unexpected(ParseError::too_small);
 
-		std::uint16_t count = *pos++ << 8;
+		std::size_t count = *pos++ << 8;
 		if (pos == end)
 			return std::unexpected(ParseError::too_small);
 		count |= *pos++;
-		
-		bool headersParsed = false;
-		row_t headers;
-		std::vector<row_t> rows;
 
+		auto headersParsed = false;
 		while (pos != end) {
-			auto columnEnd = std::find(pos, end, '\0');
-			if (columnEnd == end)
-				return std::unexpected(ParseError::too_small);
+			auto column = next_string(pos, end);
+			if (!column)
+				return std::unexpected(column.error());
 
-			auto column = std::string_view{ reinterpret_cast<const char*>(&*pos), reinterpret_cast<const char*>(&*columnEnd) };
-			pos = columnEnd + 1;
-
-			if (!headersParsed && column.ends_with(headerEnd))
-				headers.push_back(std::move(column));
+			if (!headersParsed && column->ends_with(headerEnd))
+				out.header.push_back(*column);
 			else {
-				if (headers.empty())
+				if (out.header.empty())
 					return std::unexpected(ParseError::unexpected_end);
 
-				// empty column indicates end of headers
-				if (column.empty()) {
+				// empty column indicates end of headers (afterwards empty columns are empty cells)
+				if (!headersParsed && column->empty()) {
 					headersParsed = true;
 					if (count == 0)
 						break;
@@ -110,58 +110,53 @@ struct QRTable
 					continue;
 				}
 
-				if (rows.empty() || rows.back().size() == headers.size())
-					rows.emplace_back();
-
-				rows.back().push_back(std::move(column));
-
-				if (rows.size() == count && rows.back().size() == headers.size())
+				out.cells.push_back(*column);
+				if (out.cells.size() == count * out.header.size())
 					break;
 			}
 		}
 
-		if (rows.size() < count || (!rows.empty() && rows.back().size() != headers.size()))
+		if (out.cells.size() != count * out.header.size())
 			return std::unexpected(ParseError::too_small);
 
-		return QRTable{
-			.header = headers,
-			.rows = rows
-		};
+		return {};
 	}
-};
+}
 
-std::expected<QRHeartbeatPacket, QRPacket::ParseError> QRHeartbeatPacket::Parse(const QRPacket& packet)
+std::expected<void, QRPacket::ParseError> QRHeartbeatPacket::Parse(const QRPacket& packet)
 {
+	m_Instance = packet.instance;
+	m_ServerData.clear();
+	for (auto& table : { &m_Players, &m_Teams }) {
+		table->header.clear();
+		table->cells.clear();
+	}
+
 	auto pos = packet.data.begin();
 	auto end = packet.data.end();
+	if (auto map = parse_map(pos, end, m_ServerData); !map)
+		return std::unexpected(ParseError::too_small);
 
-	if (auto map = QRMap::Parse(pos, end); map) {
-		if (auto players = QRTable::Parse(pos, end, "_"); players) {
-			if (auto teams = QRTable::Parse(pos, end, "_t"); teams) {
-				return QRHeartbeatPacket{
-					packet.type,
-					packet.instance,
-					{},
-					map->data,
-					players->header,
-					players->rows,
-					teams->header,
-					teams->rows
-				};
-			}
-		}
-		else if (end == packet.data.end()) {
-			// heartbeat without players/teams is valid
-			return QRHeartbeatPacket{
-				packet.type,
-				packet.instance,
-				{},
-				map->data
-			};
-		}
+	if (auto players = parse_table(pos, end, "_", m_Players); !players) {
+		// heartbeat without players/teams is valid
+		m_Players.header.clear();
+		m_Players.cells.clear();
+		return {};
 	}
-	
-	return std::unexpected(QRPacket::ParseError::too_small);
+
+	if (auto teams = parse_table(pos, end, "_t", m_Teams); !teams)
+		return std::unexpected(ParseError::too_small);
+
+	return {};
+}
+
+std::optional<std::string_view> QRHeartbeatPacket::find(const std::string_view& key) const noexcept
+{
+	auto iter = std::ranges::lower_bound(m_ServerData, key, {}, &KeyValue::first);
+	if (iter == m_ServerData.end() || iter->first != key)
+		return std::nullopt;
+
+	return iter->second;
 }
 
 namespace {
@@ -4,7 +4,8 @@
 #include <vector>
 #include <utility>
 #include <string>
-#include <map>
+#include <optional>
+#include <string_view>
 #include <expected>
 #include <span>
 
@@ -46,24 +47,37 @@ namespace gamespy {
 		}*/
 	};
 
-	struct QRHeartbeatPacket : QRPacket
+	// flat heartbeat parse result, all strings are views into the data of the parsed packet.
+	// the buffers are reused by subsequent calls to Parse, so parsing with a long-lived instance stops allocating once it
+	// has seen the largest heartbeat (the views are invalidated by the next call to Parse, callers copy what they keep)
+	class QRHeartbeatPacket
 	{
-		const std::map<std::string_view, std::string_view> serverData;
-		const std::vector<std::string_view> playerKeys;
-		const std::vector<std::vector<std::string_view>> playerValues;
-		const std::vector<std::string_view> teamKeys;
-		const std::vector<std::vector<std::string_view>> teamValues;
+	public:
+		using ParseError = QRPacket::ParseError;
+		using KeyValue = std::pair<std::string_view, std::string_view>;
 
-		static std::expected<QRHeartbeatPacket, ParseError> Parse(const QRPacket& packet);
+		struct Table
+		{
+			std::vector<std::string_view> header;
+			std::vector<std::string_view> cells; // row-major
+
+			std::size_t rows() const noexcept { return header.empty() ? 0 : cells.size() / header.size(); }
+			std::span<const std::string_view> row(std::size_t index) const { return std::span{ cells }.subspan(index * header.size(), header.size()); }
+		};
 
 	private:
-		using QRPacket::Parse;
-		using QRPacket::data;
+		std::array<std::uint8_t, 4> m_Instance{};
+		std::vector<KeyValue> m_ServerData; // sorted by key, the first occurence of a key wins
+		Table m_Players;
+		Table m_Teams;
 
-		/*QRHeartbeatPacket(Type type, decltype(instance) instance, decltype(server) server, decltype(playerKeys) playerKeys, decltype(playerValues) playerValues, decltype(teamKeys) teamKeys, decltype(teamValues) teamValues)
-			: QRPacket{ type, instance, {} }, server{ server }, playerKeys{ playerKeys }, playerValues{ playerValues }, teamKeys{ teamKeys }, teamValues{ teamValues }
-		{
+	public:
+		std::expected<void, ParseError> Parse(const QRPacket& packet);
 
-		}*/
+		auto& instance() const noexcept { return m_Instance; }
+		std::span<const KeyValue> serverData() const noexcept { return m_ServerData; }
+		std::optional<std::string_view> find(const std::string_view& key) const noexcept;
+		const Table& players() const noexcept { return m_Players; }
+		const Table& teams() const noexcept { return m_Teams; }
 	};
 }
\ No newline at end of file
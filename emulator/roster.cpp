@@ -0,0 +1,243 @@
+#include "roster.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+using namespace gamespy;
+
+namespace {
+	template<typename T>
+	T parse_number(const std::string_view& str)
+	{
+		auto value = T{};
+		std::from_chars(str.data(), str.data() + str.size(), value);
+		return value;
+	}
+
+	std::ptrdiff_t column_of(const QRHeartbeatPacket::Table& table, const std::string_view& name)
+	{
+		auto iter = std::ranges::find(table.header, name);
+		return iter == table.header.end() ? -1 : std::distance(table.header.begin(), iter);
+	}
+}
+
+void PlayerRoster::Update(ServerKey serverKey, const std::string_view& map, const QRHeartbeatPacket::Table& players)
+{
+	// GameSpy/qr2/qr2regkeys.h: player_, score_, ping_, team_
+	const auto nameColumn = column_of(players, "player_");
+	const auto scoreColumn = column_of(players, "score_");
+	const auto pingColumn = column_of(players, "ping_");
+	const auto teamColumn = column_of(players, "team_");
+	const auto count = nameColumn < 0 ? 0 : players.rows();
+
+	auto [iter, inserted] = m_Servers.try_emplace(serverKey);
+	auto& server = iter->second;
+	if (inserted)
+		server.map = Intern(map);
+	else if (m_Names[server.map].value != map) {
+		auto previous = server.map;
+		server.map = Intern(map);
+		Release(previous);
+	}
+
+	// surplus rows are removed first (from the back, so that the other row indices of this server stay valid)
+	while (server.rows.size() > count) {
+		auto row = server.rows.back();
+		server.rows.pop_back();
+		RemoveRow(row);
+	}
+
+	for (std::size_t i = 0; i < count; i++) {
+		const auto& cells = players.row(i);
+		const auto& name = cells[nameColumn];
+
+		std::uint32_t row;
+		if (i < server.rows.size()) {
+			row = server.rows[i];
+			if (m_Names[m_PlayerNames[row]].value != name) {
+				auto previous = m_PlayerNames[row];
+				m_PlayerNames[row] = AddPlayerName(name, row);
+				RemovePlayerName(previous, row);
+			}
+		}
+		else {
+			if (m_PlayerNames.size() >= std::numeric_limits<std::uint32_t>::max())
+				throw std::overflow_error{ "too many players" };
+
+			row = static_cast<std::uint32_t>(m_PlayerNames.size());
+			m_PlayerNames.push_back(AddPlayerName(name, row));
+			m_Scores.emplace_back();
+			m_Pings.emplace_back();
+			m_Teams.emplace_back();
+			m_PlayerServers.push_back(serverKey);
+			server.rows.push_back(row);
+		}
+
+		m_Scores[row] = scoreColumn < 0 ? 0 : ::parse_number<std::int32_t>(cells[scoreColumn]);
+		m_Pings[row] = pingColumn < 0 ? 0 : ::parse_number<std::uint16_t>(cells[pingColumn]);
+		m_Teams[row] = teamColumn < 0 ? 0 : ::parse_number<std::uint8_t>(cells[teamColumn]);
+	}
+}
+
+void PlayerRoster::Remove(ServerKey serverKey)
+{
+	auto iter = m_Servers.find(serverKey);
+	if (iter == m_Servers.end())
+		return;
+
+	auto& server = iter->second;
+	while (!server.rows.empty()) {
+		auto row = server.rows.back();
+		server.rows.pop_back();
+		RemoveRow(row);
+	}
+
+	Release(server.map);
+	m_Servers.erase(iter);
+}
+
+std::vector<PlayerRoster::Player> PlayerRoster::GetPlayers(ServerKey serverKey) const
+{
+	auto players = std::vector<Player>{};
+	if (auto iter = m_Servers.find(serverKey); iter != m_Servers.end()) {
+		for (const auto& row : iter->second.rows)
+			players.push_back(GetPlayer(row));
+	}
+
+	return players;
+}
+
+std::vector<PlayerRoster::Player> PlayerRoster::FindPlayers(const std::string_view& name) const
+{
+	auto players = std::vector<Player>{};
+	auto iter = m_NameIds.find(name);
+	if (iter == m_NameIds.end())
+		return players;
+
+	for (const auto& row : m_Names[iter->second].rows)
+		players.push_back(GetPlayer(row));
+
+	return players;
+}
+
+std::vector<PlayerRoster::Player> PlayerRoster::FindPlayersByPrefix(const std::string_view& prefix, std::size_t limit) const
+{
+	// m_NameIds is sorted, so all names with the prefix are adjacent (map names are skipped as they do not have rows)
+	auto players = std::vector<Player>{};
+	for (auto iter = m_NameIds.lower_bound(prefix); iter != m_NameIds.end() && iter->first.starts_with(prefix); ++iter) {
+		for (const auto& row : m_Names[iter->second].rows) {
+			if (players.size() >= limit)
+				return players;
+
+			players.push_back(GetPlayer(row));
+		}
+	}
+
+	return players;
+}
+
+std::vector<PlayerRoster::Player> PlayerRoster::GetAllPlayers() const
+{
+	auto players = std::vector<Player>{};
+	players.reserve(m_PlayerNames.size());
+	for (std::size_t row = 0, size = m_PlayerNames.size(); row < size; row++)
+		players.push_back(GetPlayer(static_cast<std::uint32_t>(row)));
+
+	return players;
+}
+
+std::map<std::string_view, std::size_t> PlayerRoster::GetPlayersPerMap() const
+{
+	auto result = std::map<std::string_view, std::size_t>{};
+	for (const auto& [key, server] : m_Servers)
+		result[m_Names[server.map].value] += server.rows.size();
+
+	return result;
+}
+
+PlayerRoster::NameId PlayerRoster::Intern(const std::string_view& value)
+{
+	if (auto iter = m_NameIds.find(value); iter != m_NameIds.end()) {
+		m_Names[iter->second].references++;
+		return iter->second;
+	}
+
+	auto id = NameId{};
+	if (m_FreeNames.empty()) {
+		id = static_cast<NameId>(m_Names.size());
+		m_Names.emplace_back();
+	}
+	else {
+		id = m_FreeNames.back();
+		m_FreeNames.pop_back();
+	}
+
+	auto iter = m_NameIds.emplace(std::string{ value }, id).first;
+	m_Names[id].value = iter->first;
+	m_Names[id].references = 1;
+	return id;
+}
+
+void PlayerRoster::Release(NameId id)
+{
+	auto& name = m_Names[id];
+	if (--name.references != 0)
+		return;
+
+	m_NameIds.erase(m_NameIds.find(name.value));
+	name.value = {};
+	m_FreeNames.push_back(id);
+}
+
+PlayerRoster::NameId PlayerRoster::AddPlayerName(const std::string_view& name, std::uint32_t row)
+{
+	auto id = Intern(name);
+	m_Names[id].rows.push_back(row);
+	return id;
+}
+
+void PlayerRoster::RemovePlayerName(NameId id, std::uint32_t row)
+{
+	auto& rows = m_Names[id].rows;
+	*std::ranges::find(rows, row) = rows.back();
+	rows.pop_back();
+	Release(id);
+}
+
+void PlayerRoster::RemoveRow(std::uint32_t row)
+{
+	RemovePlayerName(m_PlayerNames[row], row);
+
+	// the last row is moved into the freed row, so the row index of its server has to be updated
+	const auto last = static_cast<std::uint32_t>(m_PlayerNames.size() - 1);
+	if (row != last) {
+		m_PlayerNames[row] = m_PlayerNames[last];
+		m_Scores[row] = m_Scores[last];
+		m_Pings[row] = m_Pings[last];
+		m_Teams[row] = m_Teams[last];
+		m_PlayerServers[row] = m_PlayerServers[last];
+
+		auto& rows = m_Servers.at(m_PlayerServers[row]).rows;
+		*std::ranges::find(rows, last) = row;
+
+		auto& nameRows = m_Names[m_PlayerNames[row]].rows;
+		*std::ranges::find(nameRows, last) = row;
+	}
+
+	m_PlayerNames.pop_back();
+	m_Scores.pop_back();
+	m_Pings.pop_back();
+	m_Teams.pop_back();
+	m_PlayerServers.pop_back();
+}
+
+PlayerRoster::Player PlayerRoster::GetPlayer(std::uint32_t row) const
+{
+	return Player{
+		.name = m_Names[m_PlayerNames[row]].value,
+		.score = m_Scores[row],
+		.ping = m_Pings[row],
+		.team = m_Teams[row],
+		.server = m_PlayerServers[row]
+	};
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef _GAMESPY_ROSTER_H_
+#define _GAMESPY_ROSTER_H_
+
+#include "qr.h"
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// players reported by the game servers (player table of the heartbeats).
+	// the players are stored column-wise (one vector per attribute), so aggregations only touch the columns they need.
+	// player and map names are interned and referenced by their id, the interned names are kept sorted and know the
+	// rows they are used by (inverted index), so exact and prefix searches do not need to scan the players
+	class PlayerRoster
+	{
+	public:
+		using ServerKey = std::uint64_t; // packed ipv4 address and port (see endpoint_key)
+		using NameId = std::uint32_t;
+
+		struct Player
+		{
+			std::string_view name;
+			std::int32_t score;
+			std::uint16_t ping;
+			std::uint8_t team;
+			ServerKey server;
+		};
+
+	private:
+		// interned strings (reference counted, released ids are reused)
+		struct Name
+		{
+			std::string_view value; // key of m_NameIds
+			std::uint32_t references;
+			std::vector<std::uint32_t> rows; // players with this name
+		};
+
+		std::map<std::string, NameId, std::less<>> m_NameIds;
+		std::vector<Name> m_Names;
+		std::vector<NameId> m_FreeNames;
+
+		// one row per player
+		std::vector<NameId> m_PlayerNames;
+		std::vector<std::int32_t> m_Scores;
+		std::vector<std::uint16_t> m_Pings;
+		std::vector<std::uint8_t> m_Teams;
+		std::vector<ServerKey> m_PlayerServers;
+
+		struct Server
+		{
+			NameId map;
+			std::vector<std::uint32_t> rows;
+		};
+		std::map<ServerKey, Server> m_Servers;
+
+	public:
+		// replaces the players of the server, rows of players which are still present are overwritten in place
+		void Update(ServerKey server, const std::string_view& map, const QRHeartbeatPacket::Table& players);
+		void Remove(ServerKey server);
+
+		std::size_t size() const noexcept { return m_PlayerNames.size(); }
+		std::vector<Player> GetPlayers(ServerKey server) const;
+		std::vector<Player> FindPlayers(const std::string_view& name) const;
+		std::vector<Player> FindPlayersByPrefix(const std::string_view& prefix, std::size_t limit) const;
+		std::vector<Player> GetAllPlayers() const;
+		std::map<std::string_view, std::size_t> GetPlayersPerMap() const;
+
+	private:
+		NameId Intern(const std::string_view& value);
+		void Release(NameId id);
+		NameId AddPlayerName(const std::string_view& name, std::uint32_t row);
+		void RemovePlayerName(NameId id, std::uint32_t row);
+		void RemoveRow(std::uint32_t row);
+		Player GetPlayer(std::uint32_t row) const;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "sb_request.h"
 #include "game.h"
+#include "endpoint_table.h"
+#include <algorithm>
 #include <array>
 #include <utility>
 #include <limits>
@@ -173,10 +175,8 @@ std::vector<std::uint8_t> ServerListRequest::GetResponseHeaderBytes(const Game&
 		response.push_back(0);
 	}
 
-	// Popular values are not request specific and can be optimized:
-	// They do not need to be generated for every request
-	// (because of this, this function is not the ideal place to add them to the response) 
-	// As they are hardly ever used this is currently not implemented nor optimized via hash-map
+	// the popular values are periodically computed by the game (see Game::UpdatePopularValues),
+	// the server records then only contain their index within this list
 	const auto& popularValues = forGame.GetPopularValues();
 	response.push_back(static_cast<std::uint8_t>(popularValues.size()));
 	for (const auto& value : popularValues) {
@@ -243,7 +243,6 @@ namespace
 			bytes.append_range(boost::asio::ip::make_address_v4(server.icmp_ip).to_bytes());
 		}
 
-		const auto& popularValues = game.GetPopularValues();
 		if (!server.data.empty())
 			bytes.front() |= ServerOptions::has_keys;
 
@@ -258,9 +257,8 @@ namespace
 			{
 				// instead of pushing the full value we can just add the values's position within the popular value list
 				if (usePopularList) {
-					auto popularValuePos = std::ranges::find(popularValues, value);
-					if (popularValuePos != popularValues.end()) {
-						bytes.push_back(static_cast<std::uint8_t>(std::ranges::distance(popularValuePos, popularValues.end())));
+					if (const auto& index = game.GetPopularValueIndex(value)) {
+						bytes.push_back(*index);
 						break;
 					}
 				}
@@ -333,6 +331,143 @@ std::vector<std::uint8_t> ServerListRequest::GetServerBytes(const Game& game, co
 	return ::PrepareServer(game, server, fieldList, usePopularList);
 }
 
+std::uint64_t ServerRecordCache::HashFieldList(const std::vector<std::string_view>& fieldList, bool usePopularList)
+{
+	auto hash = utils::fnv1a(usePopularList ? "1" : "0");
+	for (const auto& field : fieldList) {
+		hash = utils::fnv1a(field, hash);
+		hash = utils::fnv1a(std::string_view{ "\0", 1 }, hash);
+	}
+
+	return hash;
+}
+
+void ServerRecordCache::CheckPopularValues(const Game& game)
+{
+	if (game.GetPopularValuesVersion() != m_PopularValues) {
+		m_Records = decltype(m_Records){};
+		m_PopularValues = game.GetPopularValuesVersion();
+	}
+}
+
+void ServerRecordCache::AppendServerBytes(std::vector<std::uint8_t>& bytes, const Game& game, const Game::SavedServer& server, const std::vector<std::string_view>& fieldList, std::uint64_t fieldListHash, bool usePopularList)
+{
+	auto error = boost::system::error_code{};
+	const auto address = boost::asio::ip::make_address_v4(server.public_ip, error);
+	if (error || server.public_port == 0) {
+		// servers without a valid ipv4 endpoint are not cached
+		bytes.append_range(::PrepareServer(game, server, fieldList, usePopularList));
+		return;
+	}
+
+	auto& records = *m_Records.try_emplace(endpoint_key(address, server.public_port)).first;
+	auto record = std::ranges::find(records, fieldListHash, &Record::fieldList);
+	if (record == records.end()) {
+		if (records.size() >= MAX_FIELD_LISTS)
+			records.erase(records.begin());
+
+		record = records.insert(records.end(), Record{ .fieldList = fieldListHash, .version = ~server.version });
+	}
+
+	// compared for inequality: a list query result might still hold an older version than the record
+	if (record->version != server.version) {
+		record->version = server.version;
+		record->bytes = ::PrepareServer(game, server, fieldList, usePopularList);
+	}
+
+	bytes.append_range(record->bytes);
+}
+
+void ServerRecordCache::Remove(const std::string_view& ip, std::uint16_t port)
+{
+	auto error = boost::system::error_code{};
+	const auto address = boost::asio::ip::make_address_v4(ip, error);
+	if (!error)
+		m_Records.erase(endpoint_key(address, port));
+}
+
+std::expected<ServerInfoRequest, ServerInfoRequest::ParseError> ServerInfoRequest::Parse(const std::span<const std::uint8_t>& packet)
+{
+	if (packet.size() < 6)
+		return std::unexpected(ParseError::insufficient_length);
+
+	return ServerInfoRequest{
+		.ip = boost::asio::ip::address_v4{ boost::asio::ip::address_v4::bytes_type{ packet[0], packet[1], packet[2], packet[3] } },
+		.port = static_cast<std::uint16_t>((packet[4] << 8) | packet[5])
+	};
+}
+
+std::vector<std::uint8_t> ServerInfoRequest::GetResponseBytes(const Game& game, const Game::SavedServer& server, const std::vector<std::string_view>& fieldList)
+{
+	// the popular values of the list header might be outdated, therefore the full values are sent
+	auto serverBytes = ::PrepareServer(game, server, fieldList, false);
+	if (serverBytes.size() > std::numeric_limits<std::uint16_t>::max()) {
+		// the rules do not fit into the message, the server is sent without them
+		auto withoutRules = server;
+		withoutRules.rules.clear();
+		serverBytes = ::PrepareServer(game, withoutRules, fieldList, false);
+	}
+
+	auto bytes = std::vector<std::uint8_t>{
+		RESPONSE_TYPE,
+		static_cast<std::uint8_t>(serverBytes.size() >> 8),
+		static_cast<std::uint8_t>(serverBytes.size())
+	};
+	bytes.append_range(serverBytes);
+	return bytes;
+}
+
+std::expected<PlayerSearchRequest, PlayerSearchRequest::ParseError> PlayerSearchRequest::Parse(const std::span<const std::uint8_t>& packet)
+{
+	auto it = packet.begin();
+	auto end = packet.end();
+
+	auto options = ::ExtractUInt32(it, end);
+	if (!options)
+		return std::unexpected(options.error());
+
+	auto maxResults = ::ExtractUInt32(it, end);
+	if (!maxResults)
+		return std::unexpected(maxResults.error());
+
+	auto name = ::ExtractString(it, end);
+	if (!name)
+		return std::unexpected(name.error());
+
+	return PlayerSearchRequest{
+		.options = static_cast<Options>(*options),
+		.maxResults = *maxResults,
+		.name = *name
+	};
+}
+
+std::vector<std::uint8_t> PlayerSearchRequest::GetResponseBytes(const std::vector<std::pair<const Game*, PlayerRoster::Player>>& players)
+{
+	auto bytes = std::vector<std::uint8_t>{ RESPONSE_TYPE, 0, 0 };
+	for (const auto& [game, player] : players) {
+		const auto endpoint = endpoint_from_key(player.server);
+		const auto port = endpoint.port();
+		const auto gamename = game->name();
+		if (bytes.size() + 4 + 2 + player.name.size() + 1 + gamename.size() + 1 > std::numeric_limits<std::uint16_t>::max())
+			break; // the remaining players do not fit into the message
+
+		bytes.append_range(endpoint.address().to_v4().to_bytes());
+		bytes.append_range(std::array{
+			static_cast<std::uint8_t>(port >> 8),
+			static_cast<std::uint8_t>(port     )
+		});
+		bytes.append_range(player.name);
+		bytes.push_back(0x00);
+		bytes.append_range(gamename);
+		bytes.push_back(0x00);
+	}
+
+	const auto length = bytes.size() - 3;
+	bytes[1] = static_cast<std::uint8_t>(length >> 8);
+	bytes[2] = static_cast<std::uint8_t>(length);
+	return bytes;
+}
+
 namespace {
 #ifdef _HASHTABLE_H
 #  undef _HASHTABLE_H
@@ -3,6 +3,7 @@
 #define _GAMESPY_SB_REQUEST_H_
 
 #include "asio.h"
+#include "endpoint_table.h"
 #include "game.h"
 #include <cstdint>
 #include <expected>
@@ -82,6 +83,74 @@ namespace gamespy
 	inline constexpr bool operator&(ServerListRequest::Options Lhs, ServerListRequest::Options Rhs) {
 		return (std::to_underlying(Lhs) & std::to_underlying(Rhs)) > 0;
 	}
+
+	// plaintext server records (see ServerListRequest::GetServerBytes) of a single game, cached per server and field list.
+	// a record is rebuilt if the server was stored again since it was built (e.g. after a heartbeat changed the server)
+	class ServerRecordCache
+	{
+		struct Record
+		{
+			std::uint64_t fieldList;   // see HashFieldList
+			std::uint64_t version;     // see Game::SavedServer::version
+			std::vector<std::uint8_t> bytes;
+		};
+
+		static constexpr std::size_t MAX_FIELD_LISTS = 4; // per server, the oldest record is replaced
+
+		EndpointTable<std::vector<Record>> m_Records;
+		std::uint64_t m_PopularValues = 0; // see Game::GetPopularValuesVersion
+
+	public:
+		static std::uint64_t HashFieldList(const std::vector<std::string_view>& fieldList, bool usePopularList);
+
+		// drops all records if the popular values of the game changed (the records contain indices into that list)
+		void CheckPopularValues(const Game& game);
+		void AppendServerBytes(std::vector<std::uint8_t>& bytes, const Game& game, const Game::SavedServer& server, const std::vector<std::string_view>& fieldList, std::uint64_t fieldListHash, bool usePopularList);
+		void Remove(const std::string_view& ip, std::uint16_t port);
+	};
+
+	// (4-byte ip)(2-byte port)
+	// sent by clients which want the full rules of a server (instead of querying the server itself)
+	struct ServerInfoRequest
+	{
+		static constexpr std::uint8_t RESPONSE_TYPE = 0x02; // PUSH_SERVER_MESSAGE
+
+		boost::asio::ip::address_v4 ip;
+		std::uint16_t port;
+
+		using ParseError = ServerListRequest::ParseError;
+		static std::expected<ServerInfoRequest, ParseError> Parse(const std::span<const std::uint8_t>& packet);
+
+		// (type)(2-byte length)(server record with the given fields and the full rules)
+		static std::vector<std::uint8_t> GetResponseBytes(const Game& game, const Game::SavedServer& server, const std::vector<std::string_view>& fieldList);
+	};
+
+	// (4-byte search options)(4-byte max results)(name)0x00
+	struct PlayerSearchRequest
+	{
+		static constexpr std::uint8_t RESPONSE_TYPE = 0x06; // PLAYERSEARCH_MESSAGE
+
+		enum class Options : std::uint32_t {
+			all_games       = 1 << 0,
+			left_substring  = 1 << 1, // prefix search
+			right_substring = 1 << 2,
+			any_substring   = 1 << 3
+		};
+
+		Options options;
+		std::uint32_t maxResults;
+		std::string_view name;
+
+		using ParseError = ServerListRequest::ParseError;
+		static std::expected<PlayerSearchRequest, ParseError> Parse(const std::span<const std::uint8_t>& packet);
+
+		// (type)(2-byte length) followed by (4-byte ip)(2-byte port)(name)0x00(gamename)0x00 for each player
+		static std::vector<std::uint8_t> GetResponseBytes(const std::vector<std::pair<const Game*, PlayerRoster::Player>>& players);
+	};
+
+	inline constexpr bool operator&(PlayerSearchRequest::Options Lhs, PlayerSearchRequest::Options Rhs) {
+		return (std::to_underlying(Lhs) & std::to_underlying(Rhs)) > 0;
+	}
 }
 
 #endif
@@ -0,0 +1,111 @@
+#include "server_index.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+using namespace gamespy;
+
+namespace {
+	// same conversion as the filter evaluation: empty numeric values are 0
+	std::optional<double> to_number(const std::string_view& value)
+	{
+		if (value.empty())
+			return 0.0;
+
+		auto number = double{};
+		const auto end = value.data() + value.size();
+		auto [ptr, ec] = std::from_chars(value.data(), end, number);
+		// nan would break the ordering of m_Numbers (nan and inf are text for the filters as well)
+		if (ec != std::errc{} || ptr != end || !std::isfinite(number))
+			return std::nullopt;
+
+		return number;
+	}
+
+	template<typename Iterator>
+	void append_servers(std::vector<std::string_view>& servers, Iterator begin, Iterator end)
+	{
+		for (; begin != end; ++begin)
+			servers.append_range(begin->second);
+	}
+}
+
+ServerIndex::ServerIndex(bool numeric)
+	: m_Numeric{ numeric }
+{
+
+}
+
+auto ServerIndex::Find(const std::string_view& value, bool create) -> Servers*
+{
+	if (!m_Numeric) {
+		auto servers = m_Text.find(value);
+		if (servers == m_Text.end() && create)
+			servers = m_Text.emplace(value, Servers{}).first;
+
+		return servers == m_Text.end() ? nullptr : &servers->second;
+	}
+
+	const auto& number = ::to_number(value);
+	if (!number)
+		return &m_NonNumeric;
+
+	auto servers = m_Numbers.find(*number);
+	if (servers == m_Numbers.end() && create)
+		servers = m_Numbers.emplace(*number, Servers{}).first;
+
+	return servers == m_Numbers.end() ? nullptr : &servers->second;
+}
+
+void ServerIndex::Add(const std::string_view& server, const std::string_view& value)
+{
+	Find(value, true)->insert(server);
+}
+
+void ServerIndex::Remove(const std::string_view& server, const std::string_view& value)
+{
+	auto servers = Find(value, false);
+	if (!servers)
+		return;
+
+	servers->erase(server);
+	if (!servers->empty() || servers == &m_NonNumeric)
+		return;
+
+	// drop the empty value (so that values() is the number of distinct values in use)
+	if (m_Numeric)
+		m_Numbers.erase(*::to_number(value));
+	else
+		m_Text.erase(m_Text.find(value));
+}
+
+std::optional<std::vector<std::string_view>> ServerIndex::Find(const ServerFilter::Constraint& constraint)
+{
+	using Type = ServerFilter::Constraint::Type;
+	auto servers = std::vector<std::string_view>{};
+	auto collect = [&](auto& values, const auto& key) {
+		switch (constraint.type) {
+		case Type::eq:
+			if (auto iter = values.find(key); iter != values.end())
+				servers.append_range(iter->second);
+			break;
+		case Type::lt: ::append_servers(servers, values.begin(), values.lower_bound(key)); break;
+		case Type::le: ::append_servers(servers, values.begin(), values.upper_bound(key)); break;
+		case Type::gt: ::append_servers(servers, values.upper_bound(key), values.end()); break;
+		case Type::ge: ::append_servers(servers, values.lower_bound(key), values.end()); break;
+		}
+	};
+
+	if (!m_Numeric)
+		collect(m_Text, std::string_view{ constraint.text });
+	else if (!constraint.number)
+		return std::nullopt;
+	else {
+		collect(m_Numbers, *constraint.number);
+		if (constraint.type == Type::gt || constraint.type == Type::ge)
+			servers.append_range(m_NonNumeric);
+	}
+
+	std::ranges::sort(servers);
+	m_Hits++;
+	return servers;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef _GAMESPY_SERVER_INDEX_H_
+#define _GAMESPY_SERVER_INDEX_H_
+
+#include "filter.h"
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// secondary index of a single server column: the (sorted) values map to the servers using them.
+	// numeric columns are ordered by number, the servers with non-numeric values are kept aside (sqlite orders them after all numbers)
+	class ServerIndex
+	{
+		using Servers = std::set<std::string_view>; // server keys, ordered like the servers of the game
+
+		bool m_Numeric;
+		std::map<std::string, Servers, std::less<>> m_Text;
+		std::map<double, Servers> m_Numbers;
+		Servers m_NonNumeric;
+		std::size_t m_Hits = 0;
+
+	public:
+		explicit ServerIndex(bool numeric);
+
+		void Add(const std::string_view& server, const std::string_view& value);
+		void Remove(const std::string_view& server, const std::string_view& value);
+
+		// the (sorted) servers which satisfy the constraint, nullopt if it cannot be answered by this index
+		std::optional<std::vector<std::string_view>> Find(const ServerFilter::Constraint& constraint);
+
+		std::size_t values() const noexcept { return m_Numeric ? m_Numbers.size() + !m_NonNumeric.empty() : m_Text.size(); }
+		std::size_t hits() const noexcept { return m_Hits; }
+
+	private:
+		Servers* Find(const std::string_view& value, bool create);
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "server_store.h"
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <print>
+#include <stdexcept>
+#include <utility>
+using namespace gamespy;
+
+namespace {
+	std::string column_definition(const ServerStore::Key& key)
+	{
+		using StoreType = ServerStore::Key::Store;
+		switch (key.store) {
+		case StoreType::as_text:    return std::format("{} TEXT", key.name);
+		case StoreType::as_real:    return std::format("{} REAL DEFAULT 0.00", key.name);
+		case StoreType::as_integer: return std::format("{} INTEGER DEFAULT 0", key.name);
+		default:
+			throw std::runtime_error{ std::format("parameter {} of invalid type {}", key.name, static_cast<int>(key.store)) };
+		}
+	}
+}
+
+std::unique_ptr<ServerStore> ServerStore::Create(const GameData& data, const StringPool& strings)
+{
+	switch (data.storage) {
+	case GameData::Storage::native: return std::make_unique<NativeServerStore>(data.keys);
+	case GameData::Storage::sqlite: return std::make_unique<SqliteServerStore>(data.name, data.keys, strings);
+	default:
+		throw std::runtime_error{ std::format("unknown server storage {}", std::to_underlying(data.storage)) };
+	}
+}
+
+SqliteServerStore::SqliteServerStore(const std::string& name, const std::vector<Key>& keys, const StringPool& strings)
+	: m_DB{ name, false }, m_Strings{ strings }
+{
+	// note: no sql injection prevention for config (static or via ini-file) based initalization
+	std::string sql = R"SQL(
+		CREATE TABLE server(
+			__last_update DATETIME DEFAULT (unixepoch()),
+			__public_ip TEXT NOT NULL,
+			__public_port INTEGER NOT NULL
+	)SQL";
+
+	for (const auto& key : keys) {
+		sql += std::format(",{}", ::column_definition(key));
+		m_Columns.push_back(key);
+	}
+
+	sql += R"SQL(
+			,PRIMARY KEY(__public_ip, __public_port)
+		);
+		CREATE TRIGGER server_last_updated AFTER UPDATE ON server FOR EACH ROW
+		BEGIN
+			UPDATE server SET __last_update=(unixepoch()) WHERE rowid=NEW.rowid;
+		END;
+	)SQL";
+
+	m_DB.exec(sql);
+}
+
+void SqliteServerStore::AddColumn(const Key& key)
+{
+	auto guard = m_DB.set_scoped_authorizer([&](auto action, auto detail1, auto detail2, auto dbName, auto trigger) {
+		using auth_action = sqlite::auth_action;
+		using auth_res = sqlite::auth_res;
+		if (action == auth_action::SQLITE_ALTER_TABLE && (detail1 == "temp" || detail1 == "main") && detail2 == "server")
+			return auth_res::SQLITE_OK;
+		else if (action == auth_action::SQLITE_FUNCTION
+			&& (detail2 == "printf" || detail2 == "substr" || detail2 == "length"))
+			return auth_res::SQLITE_OK;
+		else if (action == auth_action::SQLITE_READ
+			&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
+			&& (detail2 == "sql" || detail2 == "temp" || detail2 == "name" || detail2 == "type")
+			&& (dbName == "temp" || dbName == "main"))
+			return auth_res::SQLITE_OK;
+		else if (action == auth_action::SQLITE_UPDATE
+			&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
+			&& detail2 == "sql"
+			&& (dbName == "temp" || dbName == "main"))
+			return auth_res::SQLITE_OK;
+
+		std::println(std::cerr, "[store][columns] unauthorized: action({}) detail1({}), detail2({}), db({}), trigger({})", std::to_underlying(action), detail1, detail2, dbName, trigger);
+		// this will make the stmt throw an error
+		return sqlite::auth_res::SQLITE_DENY;
+	});
+
+	m_DB.exec(std::format("ALTER TABLE server ADD COLUMN {};", ::column_definition(key)));
+	m_Columns.push_back(key);
+	m_Upsert.reset();
+}
+
+void SqliteServerStore::Upsert(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous, std::span<const StringPool::Id> values)
+{
+	if (!m_Upsert) {
+		// all columns are written, the empty values are bound as NULL (the numeric columns default to 0)
+		auto insertSQL = std::string{ "INSERT OR REPLACE INTO server (__public_ip, __public_port" };
+		auto valuesSQL = std::string{ ") VALUES(?,?" }; // first two values: public ip + port
+		for (const auto& column : m_Columns) {
+			insertSQL += std::format(",{}", column.name);
+			switch (column.store) {
+			case Key::Store::as_integer: valuesSQL += ",coalesce(?,0)"; break;
+			case Key::Store::as_real:    valuesSQL += ",coalesce(?,0.00)"; break;
+			default:                     valuesSQL += ",?"; break;
+			}
+		}
+
+		m_Upsert.emplace(m_DB, insertSQL + valuesSQL + ')');
+	}
+
+	auto& stmt = *m_Upsert;
+	stmt.bind_at(1, ip);
+	stmt.bind_at(2, port);
+	for (std::size_t i = 0, size = m_Columns.size(); i < size; i++) {
+		if (i < values.size() && values[i] != StringPool::EMPTY)
+			stmt.bind_at(i + 3, m_Strings[values[i]]);
+		else
+			stmt.bind_at(i + 3, nullptr);
+	}
+
+	try {
+		stmt.insert();
+	}
+	catch (...) {
+		// a failed statement cannot be reset
+		m_Upsert.reset();
+		throw;
+	}
+
+	stmt.reset();
+}
+
+void SqliteServerStore::Remove(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous)
+{
+	if (!m_Remove)
+		m_Remove.emplace(m_DB, "DELETE FROM server WHERE __public_ip=? and __public_port=?");
+
+	auto& stmt = *m_Remove;
+	stmt.bind(ip, port);
+	try {
+		stmt.update();
+	}
+	catch (...) {
+		m_Remove.reset();
+		throw;
+	}
+
+	stmt.reset();
+}
+
+void SqliteServerStore::BeginBatch()
+{
+	m_DB.exec("BEGIN");
+}
+
+void SqliteServerStore::EndBatch()
+{
+	try {
+		m_DB.exec("COMMIT");
+	}
+	catch (...) {
+		m_DB.exec("ROLLBACK");
+		throw;
+	}
+}
+
+auto SqliteServerStore::GetSharedValues(std::size_t column) const -> Values
+{
+	auto values = Values{};
+	auto stmt = sqlite::stmt{ m_DB, std::format("SELECT {0},COUNT(*) FROM server WHERE {0} IS NOT NULL GROUP BY {0} HAVING COUNT(*) > 1", m_Columns.at(column).name) };
+	while (stmt.query()) {
+		// every stored value is interned by the game
+		if (const auto id = m_Strings.Find(stmt.column_at<std::string>(0)))
+			values.emplace(*id, static_cast<std::size_t>(stmt.column_at<std::int64_t>(1)));
+	}
+
+	return values;
+}
+
+NativeServerStore::NativeServerStore(const std::vector<Key>& keys)
+{
+	for (const auto& key : keys)
+		AddColumn(key);
+}
+
+void NativeServerStore::AddColumn(const Key& key)
+{
+	m_Columns.push_back(Column{ .type = key.store });
+}
+
+void NativeServerStore::Upsert(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous, std::span<const StringPool::Id> values)
+{
+	for (std::size_t i = 0, size = m_Columns.size(); i < size; i++) {
+		auto& column = m_Columns[i];
+		const auto before = i < previous.size() ? previous[i] : StringPool::EMPTY;
+		const auto after = i < values.size() ? values[i] : StringPool::EMPTY;
+
+		// most heartbeats do not change the values
+		if (column.type != Key::Store::as_text || before == after)
+			continue;
+
+		if (before != StringPool::EMPTY) {
+			if (auto count = column.counts.find(before); --count->second == 0)
+				column.counts.erase(count);
+		}
+
+		if (after != StringPool::EMPTY)
+			column.counts[after]++;
+	}
+}
+
+void NativeServerStore::Remove(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous)
+{
+	Upsert(ip, port, previous, {});
+}
+
+auto NativeServerStore::GetSharedValues(std::size_t column) const -> Values
+{
+	auto values = Values{};
+	for (const auto& [value, count] : m_Columns.at(column).counts) {
+		if (count > 1)
+			values.emplace(value, count);
+	}
+
+	return values;
+}
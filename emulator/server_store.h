@@ -0,0 +1,89 @@
+#pragma once
+#ifndef _GAMESPY_SERVER_STORE_H_
+#define _GAMESPY_SERVER_STORE_H_
+
+#include "game.h"
+#include "sqlite.h"
+#include "string_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// table of the registered servers of a game (one row per server, one column per key).
+	// the server list queries are evaluated on the servers of the game, the store provides the aggregations (popular values).
+	// the values are interned in the string pool of the game
+	class ServerStore
+	{
+	public:
+		using Key = GameData::GameKey;
+		using Values = std::map<StringPool::Id, std::size_t>; // value => servers
+
+		virtual ~ServerStore() = default;
+
+		virtual void AddColumn(const Key& key) = 0;
+
+		// the values are ordered like the columns, empty values are not stored.
+		// previous are the values of the server before the write (empty for new servers), the game keeps the servers itself
+		virtual void Upsert(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous, std::span<const StringPool::Id> values) = 0;
+		virtual void Remove(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous) = 0;
+
+		// the writes between BeginBatch and EndBatch are applied together (e.g. in one transaction)
+		virtual void BeginBatch() {}
+		virtual void EndBatch() {}
+
+		// values of a text column which are used by more than one server
+		virtual Values GetSharedValues(std::size_t column) const = 0;
+
+		static std::unique_ptr<ServerStore> Create(const GameData& data, const StringPool& strings);
+	};
+
+	// the previous storage: an in-memory sqlite database with a single table
+	class SqliteServerStore : public ServerStore
+	{
+		mutable sqlite::db m_DB;
+		std::vector<Key> m_Columns;
+		const StringPool& m_Strings;
+		std::optional<sqlite::stmt> m_Upsert; // prepared for all columns (until a column is added)
+		std::optional<sqlite::stmt> m_Remove;
+
+	public:
+		SqliteServerStore(const std::string& name, const std::vector<Key>& keys, const StringPool& strings);
+
+		void AddColumn(const Key& key) override;
+		void Upsert(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous, std::span<const StringPool::Id> values) override;
+		void Remove(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous) override;
+		void BeginBatch() override;
+		void EndBatch() override;
+		Values GetSharedValues(std::size_t column) const override;
+	};
+
+	// only counts the values of the text columns, so the shared values are known without scanning the servers.
+	// the rows are the servers of the game (see Upsert), the counted ids are kept alive by them
+	class NativeServerStore : public ServerStore
+	{
+		struct Column
+		{
+			Key::Store type;
+			Values counts; // text columns only
+		};
+
+		std::vector<Column> m_Columns;
+
+	public:
+		NativeServerStore(const std::vector<Key>& keys);
+
+		void AddColumn(const Key& key) override;
+		void Upsert(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous, std::span<const StringPool::Id> values) override;
+		void Remove(const std::string_view& ip, std::uint16_t port, std::span<const StringPool::Id> previous) override;
+		Values GetSharedValues(std::size_t column) const override;
+	};
+}
+
+#endif
\ No newline at end of file
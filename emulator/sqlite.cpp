@@ -227,6 +227,17 @@ void sqlite::stmt::bind_at(std::size_t pos, std::int64_t val)
 		throw std::runtime_error{ "Failed to bind int" };
 }
 
+void sqlite::stmt::bind_at(std::size_t pos, std::nullptr_t)
+{
+	if (pos > std::numeric_limits<int>::max())
+		throw std::overflow_error{ "column_at pos out of range" };
+
+	auto stmt = reinterpret_cast<sqlite3_stmt*>(m_Stmt.get());
+	int ec = sqlite3_bind_null(stmt, static_cast<int>(pos));
+	if (ec != SQLITE_OK)
+		throw std::runtime_error{ "Failed to bind null" };
+}
+
 
 const char* sqlite::stmt::column_text(std::size_t pos)
 {
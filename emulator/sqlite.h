@@ -1,6 +1,7 @@
 #pragma once
 #ifndef _GAMESPY_SQLITE_H_
 #define _GAMESPY_SQLITE_H_
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <filesystem>
@@ -138,13 +139,13 @@ namespace sqlite
 	public:
 		template<typename... T>
 		stmt(db& db, const detail::stmt_format<T...> sql, T&&... t)
-			: m_Stmt(prepare(db.m_DB.get(), sql.get()))
+			: m_DB(db.m_DB.get()), m_Stmt(prepare(db.m_DB.get(), sql.get()))
 		{
 			bind(std::forward<T>(t)...);
 		}
 
 		stmt(db& db, const std::string_view& str)
-			: m_Stmt(prepare(db.m_DB.get(), str))
+			: m_DB(db.m_DB.get()), m_Stmt(prepare(db.m_DB.get(), str))
 		{
 
 		}
@@ -186,6 +187,7 @@ namespace sqlite
 		void bind_at(std::size_t pos, const std::string_view& str);
 		void bind_at(std::size_t pos, std::int32_t val);
 		void bind_at(std::size_t pos, std::int64_t val);
+		void bind_at(std::size_t pos, std::nullptr_t);
 
 		template<typename T>
 		T column_at(std::size_t pos)
@@ -1,4 +1,5 @@
 #include "stats.h"
+#include "admission.h"
 #include "stats.client.h"
 #include <print>
 #include <utility>
@@ -6,8 +7,8 @@ using namespace gamespy;
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
 
-StatsServer::StatsServer(net::io_context& context, GameDB& gameDB, PlayerDB& playerDB, std::optional<boost::asio::ip::tcp::endpoint> snapshotEndpoint)
-	: m_Acceptor{ context, tcp::endpoint{ tcp::v4(), PORT } }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }, m_SnapshotEndpoint{ std::move(snapshotEndpoint) }
+StatsServer::StatsServer(net::io_context& context, Admission& admission, GameDB& gameDB, PlayerDB& playerDB, std::optional<boost::asio::ip::tcp::endpoint> snapshotEndpoint)
+	: m_Acceptor{ context, tcp::endpoint{ tcp::v4(), PORT } }, m_Admission{ admission }, m_GameDB{ gameDB }, m_PlayerDB{ playerDB }, m_SnapshotEndpoint{ std::move(snapshotEndpoint) }
 {
 	std::println("[stats] starting up: {} TCP", PORT);
 	std::println("[stats] (*.gamestats.gamespy.com)");
@@ -30,6 +31,10 @@ boost::asio::awaitable<void> StatsServer::AcceptClients()
 		if (error)
 			break;
 
+		auto endpoint = socket.remote_endpoint(error);
+		if (error || !m_Admission.Admit(endpoint.address()))
+			continue;
+
 		net::co_spawn(m_Acceptor.get_executor(), HandleIncoming(std::move(socket)), net::detached);
 	}
 }
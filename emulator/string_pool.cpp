@@ -0,0 +1,64 @@
+#include "string_pool.h"
+using namespace gamespy;
+
+StringPool::StringPool()
+	: m_Entries(1) // EMPTY
+{
+
+}
+
+auto StringPool::Intern(const std::string_view& value) -> Id
+{
+	if (value.empty())
+		return EMPTY;
+
+	if (auto iter = m_Ids.find(value); iter != m_Ids.end()) {
+		m_Entries[iter->second].references++;
+		return iter->second;
+	}
+
+	auto id = Id{};
+	if (!m_Free.empty()) {
+		id = m_Free.back();
+		m_Free.pop_back();
+	}
+	else {
+		id = static_cast<Id>(m_Entries.size());
+		m_Entries.emplace_back();
+	}
+
+	auto iter = m_Ids.emplace(value, id).first;
+	m_Entries[id] = Entry{ .value = iter->first, .references = 1 };
+	return id;
+}
+
+void StringPool::Acquire(Id id) noexcept
+{
+	if (id != EMPTY)
+		m_Entries[id].references++;
+}
+
+void StringPool::Release(Id id)
+{
+	if (id == EMPTY)
+		return;
+
+	auto& entry = m_Entries[id];
+	if (--entry.references != 0)
+		return;
+
+	m_Ids.erase(m_Ids.find(entry.value));
+	entry = Entry{};
+	m_Free.push_back(id);
+}
+
+auto StringPool::Find(const std::string_view& value) const -> std::optional<Id>
+{
+	if (value.empty())
+		return EMPTY;
+
+	if (auto iter = m_Ids.find(value); iter != m_Ids.end())
+		return iter->second;
+
+	return std::nullopt;
+}
\ No newline at end of file
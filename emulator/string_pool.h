@@ -0,0 +1,50 @@
+#pragma once
+#ifndef _GAMESPY_STRING_POOL_H_
+#define _GAMESPY_STRING_POOL_H_
+
+#include "utils.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gamespy {
+	// interned strings (reference counted, released ids are reused).
+	// the server values of a game mostly come from a small set of strings (map names, versions, countries ...),
+	// so the servers only store ids and equal values can be compared by id.
+	// the empty string has the id EMPTY and is not reference counted
+	class StringPool
+	{
+	public:
+		using Id = std::uint32_t;
+		static constexpr Id EMPTY = 0;
+
+	private:
+		struct Entry
+		{
+			std::string_view value; // key of m_Ids (the nodes are stable)
+			std::uint32_t references;
+		};
+
+		std::unordered_map<std::string, Id, utils::string_hash, std::equal_to<>> m_Ids;
+		std::vector<Entry> m_Entries; // by id
+		std::vector<Id> m_Free;
+
+	public:
+		StringPool();
+
+		Id Intern(const std::string_view& value); // adds a reference
+		void Acquire(Id id) noexcept; // adds a reference to an interned string
+		void Release(Id id);
+
+		std::optional<Id> Find(const std::string_view& value) const;
+		std::string_view operator[](Id id) const noexcept { return m_Entries[id].value; }
+		std::size_t size() const noexcept { return m_Ids.size(); }
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "../qr.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <new>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+using namespace gamespy;
+
+// counts the heap allocations of the whole program (see QRHeartbeatPacket::Parse)
+namespace {
+	std::size_t allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+	allocations++;
+	if (auto ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+namespace {
+	// battlefield2-like heartbeat: 0x03 (instance) server data, 32 players, 2 teams
+	std::vector<std::uint8_t> make_heartbeat()
+	{
+		auto data = std::string{ "\x03\x01\x02\x03\x04", 5 };
+		auto append = [&data](const std::string_view& str) {
+			data.append(str);
+			data.push_back('\0');
+		};
+
+		const std::pair<std::string_view, std::string_view> values[] = {
+			{ "gamename", "battlefield2" }, { "gamever", "1.5.3153-802.0" }, { "hostname", "benchmark server" },
+			{ "mapname", "Strike At Karkand" }, { "gametype", "gpm_cq" }, { "gamevariant", "bf2" }, { "numplayers", "32" },
+			{ "maxplayers", "64" }, { "gamemode", "openplaying" }, { "password", "0" }, { "timelimit", "0" },
+			{ "roundtime", "1" }, { "hostport", "16567" }, { "bf2_dedicated", "1" }, { "bf2_ranked", "1" },
+			{ "bf2_anticheat", "1" }, { "bf2_os", "linux-64" }, { "bf2_autorec", "0" }, { "bf2_d_idx", "" },
+			{ "bf2_d_dl", "" }, { "bf2_voip", "1" }, { "bf2_autobalanced", "1" }, { "bf2_friendlyfire", "0" },
+			{ "bf2_tkmode", "Punish" }, { "bf2_startdelay", "15" }, { "bf2_spawntime", "15.000000" },
+			{ "bf2_sponsortext", "" }, { "bf2_sponsorlogo_url", "" }, { "bf2_communitylogo_url", "" },
+			{ "bf2_scorelimit", "0" }, { "bf2_ticketratio", "100" }, { "bf2_teamratio", "100.000000" },
+			{ "bf2_team1", "MEC" }, { "bf2_team2", "US" }, { "bf2_bots", "0" }, { "bf2_pure", "1" },
+			{ "bf2_mapsize", "64" }, { "bf2_globalunlocks", "1" }, { "bf2_fps", "36.000000" },
+			{ "bf2_plasma", "0" }, { "bf2_reservedslots", "0" }, { "bf2_coopbotratio", "" },
+			{ "bf2_coopbotcount", "" }, { "bf2_coopbotdiff", "" }, { "bf2_novehicles", "0" }
+		};
+
+		for (const auto& [key, value] : values) {
+			append(key);
+			append(value);
+		}
+		append("");
+
+		const auto players = 32;
+		data.push_back(0);
+		data.push_back(players);
+		for (const auto& header : { "player_", "score_", "ping_", "team_", "deaths_", "pid_", "skill_", "AIBot_" })
+			append(header);
+		append("");
+
+		for (auto i = 0; i < players; i++) {
+			append(std::format("player{}", i));
+			append(std::to_string(i * 7));
+			append(std::to_string(20 + i));
+			append(std::to_string(1 + i % 2));
+			append(std::to_string(i % 5));
+			append(std::to_string(40000000 + i));
+			append(std::to_string(i * 3));
+			append("0");
+		}
+
+		data.push_back(0);
+		data.push_back(2);
+		for (const auto& header : { "team_t", "score_t" })
+			append(header);
+		append("");
+		for (const auto& cell : { "MEC", "120", "US", "95" })
+			append(cell);
+
+		return { data.begin(), data.end() };
+	}
+}
+
+// the parser must stop allocating once it has seen the largest heartbeat (see MasterServer::m_Heartbeat)
+int main()
+{
+	const auto buffer = make_heartbeat();
+	auto heartbeat = QRHeartbeatPacket{};
+
+	auto parse = [&]() {
+		auto packet = QRPacket::Parse(buffer);
+		return packet && heartbeat.Parse(*packet) && heartbeat.players().rows() == 32 && heartbeat.teams().rows() == 2;
+	};
+
+	// warm-up: the first parse grows the buffers
+	if (!parse()) {
+		std::println(std::cerr, "FAILED: the heartbeat could not be parsed");
+		return 1;
+	}
+
+	constexpr auto iterations = 100000;
+	const auto before = allocations;
+	const auto start = std::chrono::steady_clock::now();
+	for (auto i = 0; i < iterations; i++) {
+		if (!parse()) {
+			std::println(std::cerr, "FAILED: the heartbeat could not be parsed");
+			return 1;
+		}
+	}
+
+	const auto elapsed = std::chrono::duration<double, std::nano>{ std::chrono::steady_clock::now() - start };
+	const auto allocated = allocations - before;
+	std::println("heartbeat parse: {} bytes, {:.0f} ns/parse, {} allocations in {} parses", buffer.size(), elapsed.count() / iterations, allocated, iterations);
+	if (allocated != 0) {
+		std::println(std::cerr, "FAILED: parsing a known heartbeat allocated");
+		return 1;
+	}
+
+	return 0;
+}
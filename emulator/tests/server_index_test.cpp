@@ -0,0 +1,80 @@
+#include "../filter.h"
+#include "../server_index.h"
+#include "../string_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+using namespace gamespy;
+
+// numeric values of the heartbeats which std::from_chars accepts as double but are not numbers (see ServerIndex)
+int main()
+{
+	auto failures = 0;
+	auto check = [&failures](bool condition, const std::string_view& what) {
+		if (!condition) {
+			std::println(std::cerr, "FAILED: {}", what);
+			failures++;
+		}
+	};
+
+	// server => numplayers (indexed numeric column)
+	const auto servers = std::vector<std::pair<std::string, std::string>>{
+		{ "10.0.0.1:29900", "nan" },
+		{ "10.0.0.2:29900", "8" },
+		{ "10.0.0.3:29900", "inf" },
+		{ "10.0.0.4:29900", "2" },
+		{ "10.0.0.5:29900", "-nan" },
+		{ "10.0.0.6:29900", "12" },
+		{ "10.0.0.7:29900", "NAN" }
+	};
+
+	auto strings = StringPool{};
+	auto index = ServerIndex{ true };
+	auto rows = std::vector<std::vector<StringPool::Id>>{};
+	for (const auto& [server, value] : servers) {
+		index.Add(server, value);
+		rows.push_back({ strings.Intern(value) });
+	}
+
+	check(index.values() == 4, "nan and inf are stored as non-numeric values");
+
+	const auto resolve = [](const std::string_view& name) -> std::optional<ServerFilter::Column> {
+		if (name == "numplayers")
+			return ServerFilter::Column{ .index = 0, .numeric = true };
+
+		return std::nullopt;
+	};
+
+	for (const auto& query : { "numplayers > 5", "numplayers >= 2", "numplayers < 10", "numplayers <= 8", "numplayers = 12" }) {
+		const auto& filter = ServerFilter::Parse(query, resolve);
+		check(filter && filter->constraints().size() == 1, std::format("{}: parsed", query));
+		if (!filter || filter->constraints().empty())
+			continue;
+
+		const auto& candidates = index.Find(filter->constraints().front());
+		check(candidates.has_value(), std::format("{}: answered by the index", query));
+		if (!candidates)
+			continue;
+
+		// every matching server must be a candidate
+		for (std::size_t i = 0; i < servers.size(); i++) {
+			if (filter->Matches({ rows[i], strings }))
+				check(std::ranges::binary_search(*candidates, std::string_view{ servers[i].first }), std::format("{}: {} is a candidate", query, servers[i].first));
+		}
+	}
+
+	for (const auto& [server, value] : servers)
+		index.Remove(server, value);
+
+	check(index.values() == 0, "all servers removed");
+
+	if (failures)
+		return 1;
+
+	std::println("server index: ok");
+	return 0;
+}
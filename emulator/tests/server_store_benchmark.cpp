@@ -0,0 +1,148 @@
+#include "../server_store.h"
+#include "../string_pool.h"
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+using namespace gamespy;
+
+namespace {
+	using Key = GameData::GameKey;
+	using Clock = std::chrono::steady_clock;
+
+	const auto keys = std::vector<Key>{
+		{ .name = "hostname" },
+		{ .name = "gamever" },
+		{ .name = "mapname" },
+		{ .name = "gametype" },
+		{ .name = "country" },
+		{ .name = "numplayers", .send = Key::Send::as_byte, .store = Key::Store::as_integer },
+		{ .name = "maxplayers", .send = Key::Send::as_byte, .store = Key::Store::as_integer },
+		{ .name = "bf2_fps", .store = Key::Store::as_real }
+	};
+
+	// the writes of the game: the previous values of every server are passed along (see Game::Flush)
+	struct Servers
+	{
+		std::vector<std::string> ips;
+		std::vector<std::vector<StringPool::Id>> values; // by server
+	};
+
+	Servers make_servers(StringPool& strings, std::size_t count)
+	{
+		auto servers = Servers{};
+		for (std::size_t i = 0; i < count; i++) {
+			servers.ips.push_back(std::format("10.{}.{}.{}", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF));
+			servers.values.push_back({
+				strings.Intern(std::format("server {}", i)),
+				strings.Intern(i % 10 ? "1.5.3153-802.0" : "1.41"),
+				strings.Intern(std::format("map{}", i % 32)),
+				strings.Intern(i % 3 ? "gpm_cq" : "gpm_coop"),
+				strings.Intern(std::format("C{}", i % 50)),
+				strings.Intern(std::to_string(i % 65)),
+				strings.Intern("64"),
+				strings.Intern(std::format("{}.000000", 20 + i % 20))
+			});
+		}
+
+		return servers;
+	}
+
+	double elapsed_ms(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>{ Clock::now() - start }.count();
+	}
+
+	// the writes are batched like the writes of a game (see GameData::writeBatchSize)
+	double write_all(ServerStore& store, const Servers& servers, const std::vector<std::vector<StringPool::Id>>& previous, const std::vector<std::vector<StringPool::Id>>& values)
+	{
+		constexpr std::size_t batchSize = 512;
+		const auto start = Clock::now();
+		for (std::size_t i = 0, size = servers.ips.size(); i < size; i++) {
+			if (i % batchSize == 0)
+				store.BeginBatch();
+
+			if (values[i].empty())
+				store.Remove(servers.ips[i], 29900, previous[i]);
+			else
+				store.Upsert(servers.ips[i], 29900, previous[i], values[i]);
+
+			if (i % batchSize == batchSize - 1 || i + 1 == size)
+				store.EndBatch();
+		}
+
+		return elapsed_ms(start);
+	}
+
+	// the popular values are computed from the shared values of the text columns (see Game::UpdatePopularValues)
+	std::pair<std::vector<ServerStore::Values>, double> shared_values(const ServerStore& store)
+	{
+		const auto start = Clock::now();
+		auto shared = std::vector<ServerStore::Values>{};
+		for (std::size_t column = 0; column < keys.size(); column++) {
+			if (keys[column].store == Key::Store::as_text)
+				shared.push_back(store.GetSharedValues(column));
+		}
+
+		return { std::move(shared), elapsed_ms(start) };
+	}
+}
+
+// ingest, update and popular value latency of the native store compared to the sqlite store.
+// both stores must report the same shared values
+int main()
+{
+	auto failures = 0;
+	for (const auto count : { 10000, 50000, 100000 }) {
+		auto strings = StringPool{};
+		const auto servers = make_servers(strings, count);
+		auto updated = servers.values;
+		for (std::size_t i = 0; i < updated.size(); i++)
+			updated[i][2] = strings.Intern(std::format("map{}", (i + 1) % 32)); // map change
+
+		const auto none = std::vector<std::vector<StringPool::Id>>(count);
+		auto stores = std::vector<std::pair<std::string_view, std::unique_ptr<ServerStore>>>{};
+		stores.emplace_back("native", std::make_unique<NativeServerStore>(keys));
+		stores.emplace_back("sqlite", std::make_unique<SqliteServerStore>(std::format("server_store_benchmark_{}", count), keys, strings));
+
+		auto results = std::vector<std::vector<std::vector<ServerStore::Values>>>{}; // by store => by step
+		for (auto& [name, store] : stores) {
+			auto& steps = results.emplace_back();
+			const auto ingest = write_all(*store, servers, none, servers.values);
+			auto [ingested, ingestedLatency] = shared_values(*store);
+			steps.push_back(std::move(ingested));
+
+			const auto update = write_all(*store, servers, servers.values, updated);
+			auto [changed, changedLatency] = shared_values(*store);
+			steps.push_back(std::move(changed));
+
+			// removes the even servers, the odd ones are written again with their previous values
+			auto remaining = std::vector<std::vector<StringPool::Id>>(count);
+			for (std::size_t i = 1; i < remaining.size(); i += 2)
+				remaining[i] = updated[i];
+
+			const auto remove = write_all(*store, servers, updated, remaining);
+			auto [pruned, prunedLatency] = shared_values(*store);
+			steps.push_back(std::move(pruned));
+
+			std::println("{:>6} servers, {}: ingest {:.1f} ms, update {:.1f} ms, remove {:.1f} ms, shared values {:.3f} ms",
+				count, name, ingest, update, remove, (ingestedLatency + changedLatency + prunedLatency) / 3);
+		}
+
+		for (std::size_t step = 0; step < results[0].size(); step++) {
+			if (results[0][step] != results[1][step]) {
+				std::println(std::cerr, "FAILED: {} servers: the stores report different shared values (step {})", count, step);
+				failures++;
+			}
+		}
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef _GAMESPY_TIMING_WHEEL_H_
+#define _GAMESPY_TIMING_WHEEL_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gamespy {
+	// hierarchical timing wheel with three levels of 64 slots each:
+	// - level 0: one slot per tick (the next 64 ticks)
+	// - level 1: one slot per 64 ticks (the next 4096 ticks)
+	// - level 2: one slot per 4096 ticks (the next 262144 ticks), later deadlines are clamped and rescheduled
+	// records of a level are moved to the next lower level once the wheel reaches their slot,
+	// so advancing by one tick only touches the records which are due (or cascaded) at that tick.
+	//
+	// records are never removed or moved by the owner, instead the owner tracks the deadline of the
+	// one record it considers live and ignores (or reschedules) records which fire with a different deadline
+	template<typename Key>
+	class TimingWheel
+	{
+	public:
+		using Tick = std::uint32_t;
+
+	private:
+		static constexpr std::size_t LEVELS = 3;
+		static constexpr Tick SLOT_BITS = 6;
+		static constexpr Tick SLOTS = Tick{ 1 } << SLOT_BITS;
+		static constexpr Tick MAX_DELTA = (Tick{ 1 } << (SLOT_BITS * LEVELS)) - 1;
+
+		struct Record
+		{
+			Key key;
+			Tick deadline;
+		};
+
+		std::array<std::array<std::vector<Record>, SLOTS>, LEVELS> m_Slots;
+		std::vector<Record> m_Due; // reused buffer for the records of the current tick
+		Tick m_Now;
+		std::size_t m_Size = 0;
+
+	public:
+		explicit TimingWheel(Tick now = 0)
+			: m_Now{ now }
+		{
+
+		}
+
+		Tick now() const noexcept { return m_Now; }
+		std::size_t size() const noexcept { return m_Size; }
+		bool empty() const noexcept { return m_Size == 0; }
+
+		// deadlines which already passed fire at the next tick
+		void Schedule(const Key& key, Tick deadline)
+		{
+			Place(Record{ key, deadline }, m_Now + 1);
+			m_Size++;
+		}
+
+		// advances the wheel to the given tick and calls expired(key, deadline) for every due record
+		// the callback may schedule new records
+		template<typename F>
+		void Advance(Tick to, F&& expired)
+		{
+			while (m_Now < to) {
+				m_Now++;
+
+				// cascade the higher levels first so that their records can still fire at this tick
+				for (auto level = LEVELS - 1; level > 0; level--) {
+					const auto shift = static_cast<Tick>(SLOT_BITS * level);
+					if ((m_Now & ((Tick{ 1 } << shift) - 1)) != 0)
+						continue;
+
+					auto& slot = m_Slots[level][(m_Now >> shift) & (SLOTS - 1)];
+					m_Due.swap(slot);
+					for (const auto& record : m_Due)
+						Place(record, m_Now);
+
+					m_Due.clear();
+				}
+
+				m_Due.swap(m_Slots[0][m_Now & (SLOTS - 1)]);
+				for (const auto& record : m_Due) {
+					if (record.deadline > m_Now) {
+						// clamped record (deadline was beyond the last level)
+						Place(record, m_Now + 1);
+						continue;
+					}
+
+					m_Size--;
+					expired(record.key, record.deadline);
+				}
+
+				m_Due.clear();
+			}
+		}
+
+	private:
+		void Place(const Record& record, Tick earliest)
+		{
+			const auto at = std::max(record.deadline, earliest);
+			const auto delta = std::min<Tick>(at - m_Now, MAX_DELTA);
+			const auto slotTick = m_Now + delta;
+
+			auto level = std::size_t{ 0 };
+			while (level + 1 < LEVELS && delta >= (Tick{ 1 } << (SLOT_BITS * (level + 1))))
+				level++;
+
+			m_Slots[level][(slotTick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(record);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
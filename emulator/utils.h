@@ -42,6 +42,25 @@ namespace gamespy {
 
 		std::string md5(const std::string_view& text);
 
+		// 64-bit FNV-1a, pass the previous result as basis to hash multiple strings
+		inline constexpr std::uint64_t fnv1a_basis = 0xcbf29ce484222325;
+		constexpr std::uint64_t fnv1a(const std::string_view& data, std::uint64_t hash = fnv1a_basis) noexcept
+		{
+			for (const auto& c : data) {
+				hash ^= static_cast<std::uint8_t>(c);
+				hash *= 0x100000001b3;
+			}
+
+			return hash;
+		}
+
+		// transparent hash, allows unordered containers keyed by std::string to be searched with a std::string_view
+		struct string_hash
+		{
+			using is_transparent = void;
+			std::size_t operator()(const std::string_view& str) const noexcept { return std::hash<std::string_view>{}(str); }
+		};
+
 		template<typename T = std::string_view>
 		std::optional<T> value_for_key(const std::span<const char>& textPacket, const std::string_view& key);
 